@@ -0,0 +1,12 @@
+{
+  "targets": [
+    {
+      "target_name": "nav_addon",
+      "sources": ["nav_addon.cc"],
+      "include_dirs": ["../src"],
+      "cflags_cc": ["-std=c++17", "-O2"],
+      "cflags_cc!": ["-fno-exceptions"],
+      "libraries": ["-lfmt"]
+    }
+  ]
+}
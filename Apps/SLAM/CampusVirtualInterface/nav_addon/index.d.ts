@@ -0,0 +1,13 @@
+export interface NavGraphInfo {
+  nodes: number;
+  edges: number;
+  locations: number;
+}
+
+export class NavGraph {
+  constructor(path: string, chPath?: string | null);
+  info(): NavGraphInfo;
+  findPath(fromId: number, toId: number, firstWith?: string | null): number[];
+  findNearest(fromId: number, location: string): number[];
+  searchNeighbours(id: number, radius: number, yDist: number): number[];
+}
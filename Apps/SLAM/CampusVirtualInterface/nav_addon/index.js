@@ -0,0 +1,31 @@
+const addon = require("./build/Release/nav_addon.node");
+
+// Navigation graph written by slam_to_pg --graph-out, mapped once and queried in-process.
+// chPath optionally names the contraction hierarchy nav_contract wrote for the graph, which then answers findPath.
+class NavGraph {
+  constructor(path, chPath = null) {
+    this.handle = addon.open(path, chPath);
+  }
+
+  info() {
+    return addon.info(this.handle);
+  }
+
+  // Keyframe ids from fromId to toId, or up to the first keyframe found with the location firstWith.
+  // Empty if there is no route. Uses the contraction hierarchy, when there is one, unless firstWith is given.
+  findPath(fromId, toId, firstWith = null) {
+    return addon.findPath(this.handle, fromId, toId, firstWith);
+  }
+
+  // Keyframe ids from fromId to the nearest keyframe, along the graph, with the location
+  findNearest(fromId, location) {
+    return addon.findNearest(this.handle, fromId, location);
+  }
+
+  // Keyframe ids within radius on the floor and yDist vertically of the keyframe, in world units
+  searchNeighbours(id, radius, yDist) {
+    return addon.searchNeighbours(this.handle, id, radius, yDist);
+  }
+}
+
+module.exports = { NavGraph };
@@ -0,0 +1,224 @@
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <node_api.h>
+
+#include "util/nav_ch.hpp"
+#include "util/nav_graph.hpp"
+#include "util/nav_path.hpp"
+#include "util/spatial_grid.hpp"
+
+// Node-API binding of nav_graph, nav_path_engine, an optional contraction hierarchy (nav_ch) and a spatial_grid over the keyframe positions.
+// Queries run synchronously on the calling thread, they take microseconds, so there is no benefit in handing them to the libuv pool.
+
+namespace {
+
+// Grid cells of half a world unit, 5 m on the backend's scale, about the radius neighbour searches use
+constexpr double grid_cell_size = 0.5;
+
+// engine and grid read the graph's arrays, so open() only builds them once the graph has opened
+struct nav_handle {
+    explicit nav_handle(const std::string& path)
+        : graph(path) {}
+
+    nav_graph graph;
+    std::unique_ptr<nav_path_engine> engine;
+    std::unique_ptr<spatial_grid> grid;
+    // set when the graph was opened with a hierarchy from nav_contract, answers the routes without a location
+    std::unique_ptr<nav_ch> ch;
+    std::unique_ptr<nav_ch_query> ch_query;
+};
+
+napi_value throw_error(napi_env env, const std::string& message) {
+    napi_throw_error(env, nullptr, message.c_str());
+    return nullptr;
+}
+
+bool get_string(napi_env env, napi_value value, std::string& str) {
+    size_t length = 0;
+    if (napi_get_value_string_utf8(env, value, nullptr, 0, &length) != napi_ok) {
+        return false;
+    }
+    str.resize(length);
+    return napi_get_value_string_utf8(env, value, &str[0], length + 1, &length) == napi_ok;
+}
+
+bool get_handle(napi_env env, napi_value value, nav_handle*& handle) {
+    void* data = nullptr;
+    if (napi_get_value_external(env, value, &data) != napi_ok || !data) {
+        return false;
+    }
+    handle = static_cast<nav_handle*>(data);
+    return true;
+}
+
+// Node index of a keyframe id argument, npos if it is not a number or not in the graph
+uint32_t get_node(napi_env env, napi_value value, const nav_graph& graph) {
+    uint32_t id = 0;
+    if (napi_get_value_uint32(env, value, &id) != napi_ok) {
+        return nav_graph::npos;
+    }
+    return graph.find(id);
+}
+
+napi_value to_array(napi_env env, const nav_graph& graph, const std::vector<uint32_t>& nodes) {
+    napi_value array;
+    napi_create_array_with_length(env, nodes.size(), &array);
+    for (uint32_t i = 0; i < nodes.size(); ++i) {
+        napi_value id;
+        napi_create_uint32(env, graph.id(nodes[i]), &id);
+        napi_set_element(env, array, i, id);
+    }
+    return array;
+}
+
+// open(path, chPath) -> handle, chPath is optional
+napi_value open(napi_env env, napi_callback_info info) {
+    size_t argc = 2;
+    napi_value args[2];
+    napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+    std::string path;
+    if (argc < 1 || !get_string(env, args[0], path)) {
+        return throw_error(env, "open(path, chPath) expects the path of a navigation graph");
+    }
+    std::string ch_path;
+    napi_valuetype ch_path_type = napi_undefined;
+    if (2 <= argc && napi_typeof(env, args[1], &ch_path_type) == napi_ok
+        && ch_path_type != napi_undefined && ch_path_type != napi_null && !get_string(env, args[1], ch_path)) {
+        return throw_error(env, "open(path, chPath) expects chPath to be the path of a contraction hierarchy");
+    }
+
+    std::unique_ptr<nav_handle> handle(new nav_handle(path));
+    if (!handle->graph.is_open()) {
+        return throw_error(env, "Unable to open the navigation graph " + path);
+    }
+    const auto& graph = handle->graph;
+    handle->engine.reset(new nav_path_engine(graph));
+    handle->grid.reset(new spatial_grid(graph.x(), graph.y(), graph.z(), graph.num_nodes(), grid_cell_size));
+    if (!ch_path.empty()) {
+        handle->ch.reset(new nav_ch(ch_path, handle->graph));
+        if (!handle->ch->is_open()) {
+            return throw_error(env, "Unable to open the contraction hierarchy " + ch_path);
+        }
+        handle->ch_query.reset(new nav_ch_query(*handle->ch));
+    }
+    napi_value external;
+    const auto finalize = [](napi_env, void* data, void*) {
+        delete static_cast<nav_handle*>(data);
+    };
+    if (napi_create_external(env, handle.get(), finalize, nullptr, &external) != napi_ok) {
+        return throw_error(env, "Unable to create the navigation graph handle");
+    }
+    handle.release();
+    return external;
+}
+
+// info(handle) -> {nodes, edges, locations}
+napi_value info(napi_env env, napi_callback_info info) {
+    size_t argc = 1;
+    napi_value args[1];
+    napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+    nav_handle* handle = nullptr;
+    if (argc < 1 || !get_handle(env, args[0], handle)) {
+        return throw_error(env, "info(handle) expects a navigation graph handle");
+    }
+
+    napi_value result, nodes, edges, locations;
+    napi_create_object(env, &result);
+    napi_create_uint32(env, handle->graph.num_nodes(), &nodes);
+    napi_create_uint32(env, handle->graph.num_edges(), &edges);
+    napi_create_uint32(env, handle->graph.num_locations(), &locations);
+    napi_set_named_property(env, result, "nodes", nodes);
+    napi_set_named_property(env, result, "edges", edges);
+    napi_set_named_property(env, result, "locations", locations);
+    return result;
+}
+
+// findPath(handle, fromId, toId, firstWith) -> [keyframe ids], empty if there is no route.
+// Without firstWith the route comes from the hierarchy when the handle has one, A* on the graph otherwise.
+napi_value find_path(napi_env env, napi_callback_info info) {
+    size_t argc = 4;
+    napi_value args[4];
+    napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+    nav_handle* handle = nullptr;
+    if (argc < 3 || !get_handle(env, args[0], handle)) {
+        return throw_error(env, "findPath(handle, fromId, toId, firstWith) expects a navigation graph handle and two keyframe ids");
+    }
+
+    const auto from = get_node(env, args[1], handle->graph);
+    const auto to = get_node(env, args[2], handle->graph);
+    uint32_t location = nav_graph::npos;
+    std::string first_with;
+    if (4 <= argc && get_string(env, args[3], first_with) && !first_with.empty()) {
+        location = handle->graph.find_location(first_with);
+    }
+    if (from == nav_graph::npos || to == nav_graph::npos) {
+        return to_array(env, handle->graph, {});
+    }
+    if (handle->ch_query && first_with.empty()) {
+        return to_array(env, handle->graph, handle->ch_query->find_path(from, to).nodes);
+    }
+    return to_array(env, handle->graph, handle->engine->find_path(from, to, location).nodes);
+}
+
+// findNearest(handle, fromId, location) -> [keyframe ids], empty if no keyframe with the location is reachable
+napi_value find_nearest(napi_env env, napi_callback_info info) {
+    size_t argc = 3;
+    napi_value args[3];
+    napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+    nav_handle* handle = nullptr;
+    std::string location_name;
+    if (argc < 3 || !get_handle(env, args[0], handle) || !get_string(env, args[2], location_name)) {
+        return throw_error(env, "findNearest(handle, fromId, location) expects a navigation graph handle, a keyframe id and a location");
+    }
+
+    const auto from = get_node(env, args[1], handle->graph);
+    const auto location = handle->graph.find_location(location_name);
+    if (from == nav_graph::npos || location == nav_graph::npos) {
+        return to_array(env, handle->graph, {});
+    }
+    return to_array(env, handle->graph, handle->engine->find_nearest(from, location).nodes);
+}
+
+// searchNeighbours(handle, id, radius, yDist) -> [keyframe ids] within radius on the XZ plane and yDist vertically
+// of the keyframe, in world units, the keyframe itself excluded
+napi_value search_neighbours(napi_env env, napi_callback_info info) {
+    size_t argc = 4;
+    napi_value args[4];
+    napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+    nav_handle* handle = nullptr;
+    double radius = 0.0, y_dist = 0.0;
+    if (argc < 4 || !get_handle(env, args[0], handle) || napi_get_value_double(env, args[2], &radius) != napi_ok
+        || napi_get_value_double(env, args[3], &y_dist) != napi_ok) {
+        return throw_error(env, "searchNeighbours(handle, id, radius, yDist) expects a navigation graph handle, a keyframe id and two distances");
+    }
+
+    const auto node = get_node(env, args[1], handle->graph);
+    std::vector<uint32_t> neighbours;
+    if (node != nav_graph::npos) {
+        const auto& graph = handle->graph;
+        handle->grid->visit_within(graph.x()[node], graph.y()[node], graph.z()[node], radius, y_dist,
+                                  [node, &neighbours](const uint32_t neighbour, double) {
+                                      if (neighbour != node) {
+                                          neighbours.push_back(neighbour);
+                                      }
+                                  });
+    }
+    return to_array(env, handle->graph, neighbours);
+}
+
+napi_value init(napi_env env, napi_value exports) {
+    const napi_property_descriptor properties[] = {
+        {"open", nullptr, open, nullptr, nullptr, nullptr, napi_default, nullptr},
+        {"info", nullptr, info, nullptr, nullptr, nullptr, napi_default, nullptr},
+        {"findPath", nullptr, find_path, nullptr, nullptr, nullptr, napi_default, nullptr},
+        {"findNearest", nullptr, find_nearest, nullptr, nullptr, nullptr, napi_default, nullptr},
+        {"searchNeighbours", nullptr, search_neighbours, nullptr, nullptr, nullptr, napi_default, nullptr}};
+    napi_define_properties(env, exports, sizeof(properties) / sizeof(properties[0]), properties);
+    return exports;
+}
+
+} // namespace
+
+NAPI_MODULE(NODE_GYP_MODULE_NAME, init)
@@ -11,6 +11,7 @@
 #include "stella_vslam/util/yaml.h"
 #include "stella_vslam/util/string.h"
 #include "stella_vslam/publish/map_publisher.h"
+#include "stella_vslam/publish/frame_publisher.h"
 
 #include <iostream>
 #include <chrono>
@@ -18,6 +19,10 @@
 #include <numeric>
 #include <iomanip>
 #include <sstream>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <set>
 
 #include <opencv2/core/mat.hpp>
 #include <opencv2/core/types.hpp>
@@ -34,6 +39,11 @@ namespace fs = ghc::filesystem;
 #include "util/save_to_db.hpp"
 #include "util/handle_json.hpp"
 #include "util/yaml.h"
+#include "util/frame_pipeline.hpp"
+#include "util/keyframe_writer.hpp"
+#include "util/image_encoder.hpp"
+#include "util/video_decoder.hpp"
+#include "util/latency_histogram.hpp"
 
 #ifdef USE_STACK_TRACE_LOGGER
 #include <backward.hpp>
@@ -50,12 +60,32 @@ static int db_callback(std::vector<video_timestamp> *data, int argc, char **argv
 
 const std::string DEFAULT_UNKNOWN_GROUP = "Unknown";
 
+// Advance the video past frames that tracking will not use, without retrieving (colour converting and copying) them.
+// grab() still has to decode every frame; seeking jumps to the nearest keyframe of the GOP instead, which only pays off
+// when the skip is longer than the GOP.
+static bool skip_frames(cv::VideoCapture& video, const unsigned int num_frames, const bool use_seek) {
+    if (num_frames == 0) {
+        return true;
+    }
+    if (use_seek) {
+        const double pos = video.get(cv::CAP_PROP_POS_FRAMES);
+        return video.set(cv::CAP_PROP_POS_FRAMES, pos + num_frames);
+    }
+    for (unsigned int i = 0; i < num_frames; ++i) {
+        if (!video.grab()) {
+            return false;
+        }
+    }
+    return true;
+}
+
 
 int mono_tracking(const std::shared_ptr<stella_vslam::system>& slam,
                   const std::shared_ptr<stella_vslam::config>& cfg,
                   const std::string& video_file_path,
                   const std::string& mask_img_path,
                   const unsigned int frame_skip,
+                  const unsigned int seek_skip_threshold,
                   const unsigned int start_time,
                   const bool no_sleep,
                   const bool wait_loop_ba,
@@ -64,11 +94,16 @@ int mono_tracking(const std::shared_ptr<stella_vslam::system>& slam,
                   const std::string& map_db_path,
                   const double start_timestamp,
                   const std::string& viewer_string,
-                  nlohmann::json& json_obj,
+                  const group_timeline* timeline,
                   std::vector<timestamp_group> &timestamp_group_list,
                   const std::string& image_output_dir = "pictures/",
                   const unsigned int slam_img_width = 1920,
-                  const unsigned int slam_img_height = 960
+                  const unsigned int slam_img_height = 960,
+                  const pipeline_config& pipeline_cfg = pipeline_config(),
+                  const picture_encoding& picture_enc = picture_encoding(),
+                  const decoder_config& decoder_cfg = decoder_config(),
+                  const bool keep_system_running = false,
+                  const bool continues_session = false
                   ) {
     // load the mask image
     const cv::Mat mask = mask_img_path.empty() ? cv::Mat{} : cv::imread(mask_img_path, cv::IMREAD_GRAYSCALE);
@@ -146,26 +181,145 @@ int mono_tracking(const std::shared_ptr<stella_vslam::system>& slam,
     }
 #endif
 
-    auto video = cv::VideoCapture(video_file_path, cv::CAP_FFMPEG);
+    auto video = open_video(video_file_path, decoder_cfg);
     if (!video.isOpened()) {
         std::cerr << "Unable to open the video." << std::endl;
         return EXIT_FAILURE;
     }
     video.set(0, start_time);
+    spdlog::info("Decoding with {} threads", video.get(cv::CAP_PROP_N_THREADS));
 
-    std::vector<double> track_times;
+    const double frame_count = video.get(cv::CAP_PROP_FRAME_COUNT);
+    const double fps = video.get(cv::CAP_PROP_FPS);
 
-    cv::Mat frame;
-    cv::Mat downsized_frame;
+    std::vector<double> track_times;
+    unsigned int num_keyframes = 0;
+    stage_latencies latencies;
 
-    unsigned int num_frame = 0;
     double timestamp = start_timestamp;
 
-    bool is_not_end = true;
+    // colour is only needed for the keyframe snapshots, so without them FFmpeg hands over the luma plane of its
+    // YUV frames (OpenCV's "unsupported format, treated as 8UC1" path) and no full resolution colour pass runs at all.
+    // Otherwise the frame stays BGR for the snapshot and the resize workers convert after downscaling.
+    // Versions of OpenCV that ignore CAP_PROP_CONVERT_RGB keep decoding BGR, which the resize workers handle too.
+    const cv::Size frame_size(static_cast<int>(video.get(cv::CAP_PROP_FRAME_WIDTH)), static_cast<int>(video.get(cv::CAP_PROP_FRAME_HEIGHT)));
+    const bool decode_luma = decoder_cfg.grayscale && image_output_dir.empty() && video.set(cv::CAP_PROP_CONVERT_RGB, false);
+
+    // every frame in flight lives in one of these buffers, allocated once at the video and SLAM resolutions
+    frame_buffer_pool buffer_pool(pipeline_cfg.frame_buffers,
+                                  frame_size,
+                                  decode_luma ? CV_8UC1 : CV_8UC3,
+                                  cv::Size(slam_img_width, slam_img_height),
+                                  decoder_cfg.grayscale ? CV_8UC1 : CV_8UC3);
+
+    // decoder -> resize workers -> tracker -> image writers, each stage connected by a bounded queue
+    // so a slow stage blocks the ones before it instead of buffering the whole video in memory
+    bounded_queue<frame_packet> decode_queue(pipeline_cfg.decode_queue_depth);
+    bounded_queue<frame_packet> track_queue(pipeline_cfg.track_queue_depth);
+
+    const auto tp_start = std::chrono::steady_clock::now();
+
+    // decode the video in its own thread
+    const bool seek_skip = 0 < seek_skip_threshold && seek_skip_threshold <= frame_skip;
+    decode_rate_meter decode_rate;
+    std::thread decoder_thread([&]() {
+        unsigned int num_frame = 0;
+        unsigned long seq = 0;
+        decode_rate.start();
+        while (true) {
+            auto buffer = buffer_pool.acquire();
+            if (!buffer) {
+                break; // the tracker has stopped
+            }
+            const auto tp_read = std::chrono::steady_clock::now();
+            if (!video.read(buffer->frame)) {
+                break;
+            }
+            // a single channel frame that is not frame_size is not a luma plane (e.g. a packed or hardware format),
+            // so go back to BGR output from the next frame on
+            if (buffer->frame.channels() == 1 && buffer->frame.size() != frame_size) {
+                spdlog::warn("The decoder returned a {}x{} single channel frame for a {}x{} video, decoding BGR instead",
+                             buffer->frame.cols, buffer->frame.rows, frame_size.width, frame_size.height);
+                video.set(cv::CAP_PROP_CONVERT_RGB, true);
+                ++num_frame;
+                continue;
+            }
+            const auto decode_time = std::chrono::steady_clock::now() - tp_read;
+            decode_rate.add_decode_time(decode_time);
+            latencies.decode.record(decode_time);
+            const double ms = video.get(cv::CAP_PROP_POS_MSEC);
+
+            if (!buffer->frame.empty()) {
+                frame_packet packet;
+                packet.seq = seq++;
+                packet.num_frame = num_frame;
+                packet.ms = ms;
+                packet.progress = ((ms / 1000) / (frame_count / fps)) * 100;
+                packet.buffer = std::move(buffer);
+                if (!decode_queue.push(std::move(packet))) {
+                    break; // the tracker has stopped
+                }
+            }
+
+            ++num_frame;
+
+            if (num_frame > 10 && ms == 0) {
+                break; // The video has finished and is spitting out 0ms
+            }
+
+            if (1 < frame_skip) {
+                const auto tp_skip = std::chrono::steady_clock::now();
+                if (!skip_frames(video, frame_skip - 1, seek_skip)) {
+                    break;
+                }
+                decode_rate.add_decode_time(std::chrono::steady_clock::now() - tp_skip, frame_skip - 1);
+                num_frame += frame_skip - 1;
+            }
+        }
+        decode_queue.close();
+        decode_rate.log();
+    });
+
+    // downsize to the SLAM resolution
+    const unsigned int num_resize_threads = std::max(1u, pipeline_cfg.resize_threads);
+    std::atomic<unsigned int> active_resize_threads{num_resize_threads};
+    std::vector<std::thread> resize_threads;
+    for (unsigned int i = 0; i < num_resize_threads; ++i) {
+        resize_threads.emplace_back([&]() {
+            frame_packet packet;
+            cv::Mat downsized_colour; // reused across frames by this worker
+            while (decode_queue.pop(packet)) {
+                auto& buffer = *packet.buffer;
+                const auto tp_resize = std::chrono::steady_clock::now();
+                if (buffer.downsized_frame.channels() == 1 && buffer.frame.channels() == 3) {
+                    // convert at the SLAM resolution, after the downscale has read the colour frame once
+                    downscale_frame(buffer.frame, downsized_colour, buffer.downsized_frame.size(), pipeline_cfg.resize_method);
+                    cv::cvtColor(downsized_colour, buffer.downsized_frame, cv::COLOR_BGR2GRAY);
+                }
+                else {
+                    downscale_frame(buffer.frame, buffer.downsized_frame, buffer.downsized_frame.size(), pipeline_cfg.resize_method);
+                }
+                latencies.resize.record(std::chrono::steady_clock::now() - tp_resize);
+                if (!track_queue.push(std::move(packet))) {
+                    break;
+                }
+            }
+            if (--active_resize_threads == 0) {
+                track_queue.close();
+            }
+        });
+    }
+
+    // save keyframe snapshots off the tracking thread
+    const std::vector<int> picture_params = picture_enc.params();
+    keyframe_writer image_writer(pipeline_cfg.writer_threads, pipeline_cfg.writer_queue_depth);
 
     // run the slam in another thread
     std::thread thread([&]() {
-        while (is_not_end) {
+        frame_reorder_buffer reorder_buffer(track_queue);
+        frame_packet packet;
+        bool session_start_checked = false;
+        while (reorder_buffer.pop(packet)) {
 #ifdef HAVE_IRIDESCENCE_VIEWER
             while (true) {
                 {
@@ -192,76 +346,70 @@ int mono_tracking(const std::shared_ptr<stella_vslam::system>& slam,
                 }
             }
 
-            
-            is_not_end = video.read(frame);
-            double ms = video.get(cv::CAP_PROP_POS_MSEC);
-            double frame_count = video.get(cv::CAP_PROP_FRAME_COUNT);
-            double fps = video.get(cv::CAP_PROP_FPS);
+            const double ms = packet.ms;
             timestamp = start_timestamp + (ms/1000);
-            
-            
 
             const auto tp_1 = std::chrono::steady_clock::now();
 
-            
-
-            if (!frame.empty() && (num_frame % frame_skip == 0)) {
-
-
-
-                cv::resize(frame, downsized_frame, cv::Size(slam_img_width, slam_img_height));
-		        bool is_keyframe = slam->feed_monocular_frame_bool(downsized_frame, timestamp, mask);
-                
-                std::cout << "Frame - Progress: " <<  ((ms/1000) / (frame_count/fps)) * 100 << "% - ms: " << ms << std::endl;
-
-                if (!image_output_dir.empty()) {
-                    // Save image to work on front end
-                    std::stringstream stream;
-                    stream << std::fixed << std::setprecision(5) << timestamp; // Sqlite3 REAL datatype seems only accurate to 5dp, so use 5dp for identifier
-                    std::string timestamp_string = stream.str();              
-                 
-                    std::string filepath = image_output_dir + timestamp_string + ".png";
-
-                    if (is_keyframe || num_frame == 0){
-                        
-                        std::vector<int> params; 
-                        params.push_back(cv::IMWRITE_JPEG_QUALITY); 
-                        params.push_back(100); // 0-100 - 100 = highest quality
-                        // params.push_back(cv::IMWRITE_JPEG_PROGRESSIVE); // Progressive JPGs used for reduced loading times for frontend
-                        // params.push_back(1); // 1 = true, 0 = false 
-                        cv::imwrite(filepath, frame, params); 
-                        
-                        if (json_obj != NULL){
-                            
-                            std::string group = find_group_from_json(json_obj, ms);
-                            timestamp_group_list.emplace_back(group, timestamp, ms);
-                            std::cout << "Keyframe made - Location: " << group << std::endl;
-                        }
-                        else{
-                            timestamp_group_list.emplace_back(DEFAULT_UNKNOWN_GROUP, timestamp, ms);
-                            std::cout << "JSON Obj was null! - Using default:" << DEFAULT_UNKNOWN_GROUP << std::endl;
-                        }
-                        
+            bool is_keyframe = slam->feed_monocular_frame_bool(packet.buffer->downsized_frame, timestamp, mask);
+            latencies.track.record(std::chrono::steady_clock::now() - tp_1);
+            if (continues_session && !session_start_checked) {
+                // nothing resets the tracker between the videos of a session, see main
+                session_start_checked = true;
+                if (slam->get_frame_publisher()->get_tracking_state() == "Tracking") {
+                    spdlog::warn("The first frame of {} tracked on from the previous video without relocalizing", video_file_path);
+                }
+            }
+            if (is_keyframe) {
+                ++num_keyframes;
+            }
+
+            std::cout << "Frame - Progress: " << packet.progress << "% - ms: " << ms << std::endl;
+
+            if (!image_output_dir.empty()) {
+                // Save image to work on front end
+                std::stringstream stream;
+                stream << std::fixed << std::setprecision(5) << timestamp; // Sqlite3 REAL datatype seems only accurate to 5dp, so use 5dp for identifier
+                std::string timestamp_string = stream.str();
+
+                std::string filepath = image_output_dir + timestamp_string + picture_enc.extension();
+
+                if (is_keyframe || packet.num_frame == 0){
+
+                    const auto tp_keyframe = std::chrono::steady_clock::now();
+                    image_writer.enqueue(filepath, std::move(packet.buffer), picture_params);
+                    latencies.keyframe.record(std::chrono::steady_clock::now() - tp_keyframe);
+
+                    if (timeline){
+
+                        const auto tp_lookup = std::chrono::steady_clock::now();
+                        const std::string& group = timeline->lookup(packet.ms);
+                        latencies.json_lookup.record(std::chrono::steady_clock::now() - tp_lookup);
+                        timestamp_group_list.emplace_back(group, timestamp, ms);
+                        std::cout << "Keyframe made - Location: " << group << std::endl;
+                    }
+                    else{
+                        timestamp_group_list.emplace_back(DEFAULT_UNKNOWN_GROUP, timestamp, ms);
+                        std::cout << "JSON Obj was null! - Using default:" << DEFAULT_UNKNOWN_GROUP << std::endl;
                     }
+
                 }
             }
+            // only keyframes keep their colour frame, everything else goes straight back to the pool
+            packet.buffer.reset();
 
             const auto tp_2 = std::chrono::steady_clock::now();
 
             const auto track_time = std::chrono::duration_cast<std::chrono::duration<double>>(tp_2 - tp_1).count();
-            if (num_frame % frame_skip == 0) {
-                track_times.push_back(track_time);
-            }
+            track_times.push_back(track_time);
 
-            // wait until the timestamp of the next frame
+            // wait until the timestamp of the next frame, skipped frames never reach the tracker
             if (!no_sleep) {
-                const auto wait_time = 1.0 / slam->get_camera()->fps_ - track_time;
+                const auto wait_time = frame_skip / slam->get_camera()->fps_ - track_time;
                 if (0.0 < wait_time) {
                     std::this_thread::sleep_for(std::chrono::microseconds(static_cast<unsigned int>(wait_time * 1e6)));
                 }
             }
-            
-            ++num_frame;
 
 
 #ifdef HAVE_IRIDESCENCE_VIEWER
@@ -278,11 +426,13 @@ int mono_tracking(const std::shared_ptr<stella_vslam::system>& slam,
                 break;
             }
 #endif
-            if (num_frame > 10 && ms == 0){
-                break; // The video has finished and is spitting out 0ms
-            }
         }
 
+        // stop the decoder and resize workers if tracking ended early
+        track_queue.close();
+        decode_queue.close();
+        buffer_pool.close();
+
         // wait until the loop BA is finished
         while (slam->loop_BA_is_running()) {
             std::this_thread::sleep_for(std::chrono::microseconds(5000));
@@ -316,9 +466,25 @@ int mono_tracking(const std::shared_ptr<stella_vslam::system>& slam,
     }
 
     thread.join();
+    const auto elapsed = std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - tp_start).count();
+    decoder_thread.join();
+    for (auto& resize_thread : resize_threads) {
+        resize_thread.join();
+    }
 
-    // shutdown the slam process
-    slam->shutdown();
+    // let the writers drain the queued keyframe snapshots
+    image_writer.shutdown();
+    image_writer.log_stats();
+    for (const auto write_time : image_writer.get_stats().write_times) {
+        latencies.encode.record_seconds(write_time);
+    }
+    latencies.log();
+    spdlog::info("Frame buffer pool: decoder waited for a free buffer {} times", buffer_pool.num_waits());
+
+    // shutdown the slam process, unless the next video of the session continues on it
+    if (!keep_system_running) {
+        slam->shutdown();
+    }
 
     if (!eval_log_dir.empty()) {
         // output the trajectories for evaluation
@@ -332,6 +498,40 @@ int mono_tracking(const std::shared_ptr<stella_vslam::system>& slam,
             }
             ofs.close();
         }
+        // output the keyframe snapshot write times
+        std::ofstream ofs_write(eval_log_dir + "/keyframe_write_times.txt", std::ios::out);
+        if (ofs_write.is_open()) {
+            for (const auto write_time : image_writer.get_stats().write_times) {
+                ofs_write << write_time << std::endl;
+            }
+            ofs_write.close();
+        }
+        // output the per stage latency histograms
+        std::ofstream ofs_latencies(eval_log_dir + "/stage_latencies.json", std::ios::out);
+        if (ofs_latencies.is_open()) {
+            ofs_latencies << latencies.to_json().dump(4) << std::endl;
+            ofs_latencies.close();
+        }
+        // output the run summary, read back by resolution_sweep
+        std::vector<std::shared_ptr<stella_vslam::data::keyframe>> map_keyfrms;
+        std::vector<std::shared_ptr<stella_vslam::data::landmark>> map_landmarks;
+        std::set<std::shared_ptr<stella_vslam::data::landmark>> local_landmarks;
+        nlohmann::json summary;
+        summary["video"] = video_file_path;
+        summary["cols"] = slam_img_width;
+        summary["rows"] = slam_img_height;
+        summary["frame_skip"] = frame_skip;
+        summary["num_frames"] = track_times.size();
+        summary["elapsed"] = elapsed;
+        summary["fps"] = 0.0 < elapsed ? track_times.size() / elapsed : 0.0;
+        summary["num_keyframes"] = num_keyframes;
+        summary["map_keyframes"] = slam->get_map_publisher()->get_keyframes(map_keyfrms);
+        summary["map_landmarks"] = slam->get_map_publisher()->get_landmarks(map_landmarks, local_landmarks);
+        std::ofstream ofs_summary(eval_log_dir + "/tracking_summary.json", std::ios::out);
+        if (ofs_summary.is_open()) {
+            ofs_summary << summary.dump(4) << std::endl;
+            ofs_summary.close();
+        }
     }
 
     std::sort(track_times.begin(), track_times.end());
@@ -348,6 +548,60 @@ int mono_tracking(const std::shared_ptr<stella_vslam::system>& slam,
     return timestamp;
 }
 
+int picture_benchmark(const std::string& video_file_path,
+                      const unsigned int num_frames,
+                      const unsigned int frame_skip,
+                      const unsigned int seek_skip_threshold) {
+    auto video = cv::VideoCapture(video_file_path, cv::CAP_FFMPEG);
+    if (!video.isOpened()) {
+        std::cerr << "Unable to open the video." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // sample frames the same way tracking does
+    const bool seek_skip = 0 < seek_skip_threshold && seek_skip_threshold <= frame_skip;
+    std::vector<cv::Mat> frames;
+    while (frames.size() < num_frames) {
+        cv::Mat frame;
+        if (!video.read(frame)) {
+            break;
+        }
+        if (!frame.empty()) {
+            frames.push_back(frame);
+        }
+        if (1 < frame_skip && !skip_frames(video, frame_skip - 1, seek_skip)) {
+            break;
+        }
+    }
+    std::cout << "Picture benchmark over " << frames.size() << " frames of " << video_file_path << std::endl;
+
+    std::vector<picture_encoding> encodings;
+    for (const int png_compression : {0, 1, 3, 6, 9}) {
+        picture_encoding encoding;
+        encoding.format = picture_format_t::PNG;
+        encoding.png_compression = png_compression;
+        encodings.push_back(encoding);
+    }
+    for (const int quality : {80, 90, 95, 100}) {
+        picture_encoding encoding;
+        encoding.format = picture_format_t::JPEG;
+        encoding.quality = quality;
+        encodings.push_back(encoding);
+    }
+    for (const int quality : {75, 90, 100}) {
+        picture_encoding encoding;
+        encoding.format = picture_format_t::WEBP;
+        encoding.quality = quality;
+        encodings.push_back(encoding);
+    }
+    picture_encoding raw_encoding;
+    raw_encoding.format = picture_format_t::RAW;
+    encodings.push_back(raw_encoding);
+
+    benchmark_picture_encodings(frames, encodings);
+    return EXIT_SUCCESS;
+}
+
 int main(int argc, char* argv[]) {
     int ret;
     sqlite3* db = nullptr;
@@ -363,6 +617,7 @@ int main(int argc, char* argv[]) {
     auto config_file_path = op.add<popl::Value<std::string>>("c", "config", "config file path");
     auto mask_img_path = op.add<popl::Value<std::string>>("", "mask", "mask image path", "");
     auto frame_skip = op.add<popl::Value<unsigned int>>("", "frame-skip", "interval of frame skip", 1);
+    auto seek_skip_threshold = op.add<popl::Value<unsigned int>>("", "seek-skip", "seek instead of grabbing skipped frames when --frame-skip is at least this (use the GOP length, 0 = never seek)", 0);
     auto start_time = op.add<popl::Value<unsigned int>>("s", "start-time", "time to start playing [milli seconds]", 0);
     auto no_sleep = op.add<popl::Switch>("", "no-sleep", "not wait for next frame in real time");
     auto wait_loop_ba = op.add<popl::Switch>("", "wait-loop-ba", "wait until the loop BA is finished");
@@ -378,6 +633,21 @@ int main(int argc, char* argv[]) {
     auto videos = op.add<popl::Value<std::string>>("", "videos", "set of comma separated videos files to process (e.g. g-block.mp4,g-block2.mp4)");
     auto video_dir = op.add<popl::Value<std::string>>("", "video-dir", "directory containing video files, if not set must be part of the videos option");
     auto img_output_dir = op.add<popl::Value<std::string>>("p", "picture-dir", "Directory to put keyframe img snapshots in", "pictures/");
+    auto picture_format = op.add<popl::Value<std::string>>("", "picture-format", "keyframe img snapshot format [png, jpg, webp, raw]", "png");
+    auto picture_quality = op.add<popl::Value<int>>("", "picture-quality", "JPEG/WebP quality of keyframe img snapshots (0-100)", 95);
+    auto png_compression = op.add<popl::Value<int>>("", "png-compression", "PNG compression level of keyframe img snapshots (0-9)", 1);
+    auto jpeg_progressive = op.add<popl::Switch>("", "jpeg-progressive", "save keyframe img snapshots as progressive JPGs");
+    auto picture_benchmark_frames = op.add<popl::Value<unsigned int>>("", "picture-benchmark", "encode this many frames of the first video with every picture format, report the cost and exit", 0);
+    auto decode_queue_depth = op.add<popl::Value<unsigned int>>("", "decode-queue", "number of decoded frames buffered ahead of the resize workers", 8);
+    auto resize_threads = op.add<popl::Value<unsigned int>>("", "resize-threads", "number of threads downsizing frames for tracking", 2);
+    auto resize_method = op.add<popl::Value<std::string>>("", "resize-method", "downsizing of frames for tracking [linear, area, equirect]", "linear");
+    auto track_queue_depth = op.add<popl::Value<unsigned int>>("", "track-queue", "number of downsized frames buffered ahead of the tracker", 8);
+    auto writer_threads = op.add<popl::Value<unsigned int>>("", "writer-threads", "number of threads saving keyframe snapshots", 2);
+    auto writer_queue_depth = op.add<popl::Value<unsigned int>>("", "writer-queue", "number of keyframe snapshots waiting to be saved", 16);
+    auto frame_buffers = op.add<popl::Value<unsigned int>>("", "frame-buffers", "number of preallocated frame buffers shared by all pipeline stages", 16);
+    auto session = op.add<popl::Switch>("", "session", "keep one SLAM system and its map in memory for all --videos and save the map once at the end");
+    auto checkpoint_every = op.add<popl::Value<unsigned int>>("", "checkpoint-every", "with --session, also save the map after every this many videos (0 = only at the end)", 0);
+    auto metadata_wal = op.add<popl::Switch>("", "metadata-wal", "write the keyframe groups and video times with WAL journaling and synchronous=NORMAL");
    
     try {
         op.parse(argc, argv);
@@ -459,6 +729,39 @@ int main(int argc, char* argv[]) {
         return EXIT_FAILURE;
     }
 
+    picture_encoding picture_enc;
+    try {
+        picture_enc.format = picture_format_from_string(picture_format->value());
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    picture_enc.quality = picture_quality->value();
+    picture_enc.png_compression = png_compression->value();
+    picture_enc.jpeg_progressive = jpeg_progressive->is_set();
+
+    pipeline_config pipeline_cfg;
+    try {
+        pipeline_cfg.resize_method = downscale_method_from_string(resize_method->value());
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    pipeline_cfg.decode_queue_depth = decode_queue_depth->value();
+    pipeline_cfg.resize_threads = resize_threads->value();
+    pipeline_cfg.track_queue_depth = track_queue_depth->value();
+    pipeline_cfg.writer_threads = writer_threads->value();
+    pipeline_cfg.writer_queue_depth = writer_queue_depth->value();
+    pipeline_cfg.frame_buffers = frame_buffers->value();
+
+    if (picture_benchmark_frames->value() > 0) {
+        const auto first_video = stella_vslam::util::split_string(videos->value(), ',').front();
+        const auto benchmark_video_path = video_dir->is_set() ? fs::path(video_dir->value()).string() + "/" + first_video : first_video;
+        return picture_benchmark(benchmark_video_path, picture_benchmark_frames->value(), frame_skip->value(), seek_skip_threshold->value());
+    }
+
 #ifdef USE_GOOGLE_PERFTOOLS
     ProfilerStart("slam.prof");
 #endif
@@ -474,6 +777,8 @@ int main(int argc, char* argv[]) {
 
     std::vector<video_timestamp> video_timestamps_list = load_video_timestamps(db);
     std::vector<timestamp_group> timestamp_group_list = load_timestamp_groups(db);
+    const size_t num_loaded_videos = video_timestamps_list.size();
+    const size_t num_loaded_groups = timestamp_group_list.size();
 
     sqlite3_close(db);
 
@@ -498,49 +803,24 @@ int main(int argc, char* argv[]) {
 
 
 
-    for (const auto& video_file : stella_vslam::util::split_string(videos->value(), ',')) {
-        if (video_dir->is_set()) {
-             video_file_path = fs::path(video_dir->value()).string() + "/" + video_file;
-        }
-        else {
-            video_file_path = video_file;
-        }
-        std::cout << "Processing video: " << video_file_path << std::endl;
-
-        nlohmann::json json_obj;
-        if (json_dir->is_set()){
-            const auto vid_path = fs::path(video_file_path);
-            const auto video_name = vid_path.stem().string() + ".json";
-
-            json_obj = filename_to_json_obj(video_name, json_dir->value());
-
-            if (json_obj != NULL){
-                std::cout << json_obj["name"] << std::endl;
-                std::cout << json_obj["data"] << std::endl;
-            }
-            else{
-                std::cout << "Failed to open JSON file " << video_name << std::endl;
-            }
-        }
-
-
-        // build a slam system
+    // build a slam system and load the maps of map_db, nullptr if a map failed to load
+    const auto build_slam_system = [&](const std::string& map_db) -> std::shared_ptr<stella_vslam::system> {
         auto slam = std::make_shared<stella_vslam::system>(cfg, vocab_file_path->value());
         bool need_initialize = true;
-        if (!map_db_in.empty()) {
+        if (!map_db.empty()) {
             need_initialize = false;
-            const auto path = fs::path(map_db_in);
+            const auto path = fs::path(map_db);
             if (path.extension() == ".yaml") {
                 YAML::Node node = YAML::LoadFile(path);
                 for (const auto& map_path : node["maps"].as<std::vector<std::string>>()) {
                     if (!slam->load_map_database(path.parent_path() / map_path)) {
-                        return EXIT_FAILURE;
+                        return nullptr;
                     }
                 }
             }
             else {
                 if (!slam->load_map_database(path)) {
-                    return EXIT_FAILURE;
+                    return nullptr;
                 }
             }
         }
@@ -552,6 +832,57 @@ int main(int argc, char* argv[]) {
             slam->enable_temporal_mapping();
             slam->disable_loop_detector();
         }
+        return slam;
+    };
+
+    // In a session the vocabulary is read once and the map stays in memory between videos instead of being
+    // saved and reloaded after each one. stella_vslam cannot put only the tracker back into the lost state, so
+    // relocalizing at the start of every following video is best effort: usually the jump to the new video loses
+    // track and the tracker relocalizes against the resident map, as it would after loading the map, but a first
+    // frame close enough to the last pose tracks on from it. mono_tracking logs the videos where that happens.
+    std::shared_ptr<stella_vslam::system> session_slam;
+    if (session->is_set()) {
+        session_slam = build_slam_system(map_db_in);
+        if (!session_slam) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    const auto video_files = stella_vslam::util::split_string(videos->value(), ',');
+    for (unsigned int video_idx = 0; video_idx < video_files.size(); ++video_idx) {
+        const auto& video_file = video_files.at(video_idx);
+        if (video_dir->is_set()) {
+             video_file_path = fs::path(video_dir->value()).string() + "/" + video_file;
+        }
+        else {
+            video_file_path = video_file;
+        }
+        std::cout << "Processing video: " << video_file_path << std::endl;
+
+        // the group timeline is compiled once per video, keyframes look their group up in it
+        group_timeline timeline;
+        bool has_timeline = false;
+        if (json_dir->is_set()){
+            const auto vid_path = fs::path(video_file_path);
+            const auto video_name = vid_path.stem().string() + ".json";
+
+            has_timeline = load_group_timeline(video_name, json_dir->value(), timeline);
+
+            if (has_timeline){
+                std::cout << timeline.name() << " - " << timeline.num_entries() << " timeline entries, "
+                          << timeline.num_groups() << " groups" << std::endl;
+            }
+            else{
+                std::cout << "Failed to open JSON file " << video_name << std::endl;
+            }
+        }
+
+
+        // build a slam system, or continue on the one of the session
+        auto slam = session->is_set() ? session_slam : build_slam_system(map_db_in);
+        if (!slam) {
+            return EXIT_FAILURE;
+        }
 
         auto img_size = yaml_optional_ref(cfg->yaml_node_, "Camera");
 
@@ -563,19 +894,25 @@ int main(int argc, char* argv[]) {
                                 video_file_path,
                                 mask_img_path->value(),
                                 frame_skip->value(),
+                                seek_skip_threshold->value(),
                                 start_time->value(),
                                 no_sleep->is_set(),
                                 wait_loop_ba->is_set(),
                                 true /* Video loop should always autoterm*/,
                                 eval_log_dir->value(),
-                                map_db_path_out->value(),
+                                session->is_set() ? "" : map_db_path_out->value(),
                                 timestamp,
                                 viewer_string, 
-                                json_obj, 
+                                has_timeline ? &timeline : nullptr,
                                 timestamp_group_list,
                                 img_output_dir->value(),
                                 img_size["cols"].as<unsigned int>(),
-                                img_size["rows"].as<unsigned int>()
+                                img_size["rows"].as<unsigned int>(),
+                                pipeline_cfg,
+                                picture_enc,
+                                load_decoder_config(yaml_optional_ref(cfg->yaml_node_, "Decoder")),
+                                session->is_set(),
+                                session->is_set() && 0 < video_idx
                                 );
         }
         else {
@@ -586,11 +923,37 @@ int main(int argc, char* argv[]) {
         video_timestamps_list.emplace_back(video_file_path, timestamp, finish_timestamp);
         
         timestamp = finish_timestamp + 1;
+
+        if (session->is_set()) {
+            if (slam->terminate_is_requested()) {
+                break;
+            }
+            const bool is_last_video = video_idx + 1 == video_files.size();
+            if (0 < checkpoint_every->value() && (video_idx + 1) % checkpoint_every->value() == 0
+                && !is_last_video && !map_db_path_out->value().empty()) {
+                if (!slam->save_map_database(map_db_path_out->value())) {
+                    return EXIT_FAILURE;
+                }
+                std::cout << "Map checkpoint is saved to " << map_db_path_out->value() << std::endl;
+            }
+            continue;
+        }
+
         std::cout << "Map database is saved to " << map_db_path_out->value() << std::endl;
 
         map_db_in = map_db_path_out->value(); // Running in a loop, must build on previous video maps
     }
 
+    if (session_slam) {
+        session_slam->shutdown();
+        if (!map_db_path_out->value().empty()) {
+            if (!session_slam->save_map_database(map_db_path_out->value())) {
+                return EXIT_FAILURE;
+            }
+            std::cout << "Map database is saved to " << map_db_path_out->value() << std::endl;
+        }
+    }
+
 
     db = nullptr;
     ret = sqlite3_open(map_db_path_out->value().c_str(), &db);
@@ -598,17 +961,34 @@ int main(int argc, char* argv[]) {
         spdlog::error("Failed to open SQL database");
         return 1;
     }
-        
+
     for (auto& timestamp_group : timestamp_group_list) {
-        save_timestamp_groups_to_db(db, timestamp_group.group , timestamp_group.timestamp, timestamp_group.ms);
         std::cout << "Group: " << timestamp_group.group << " Timestamp: " << timestamp_group.timestamp <<  " Ms: " << timestamp_group.ms << std::endl;
     }
 
     for (auto& video_timestamp : video_timestamps_list) {
-        save_video_to_db(db, video_timestamp.name , video_timestamp.start_timestamp, video_timestamp.stop_timestamp);
         std::cout << "Video: " << video_timestamp.name << " Start: " << video_timestamp.start_timestamp << " End: " << video_timestamp.stop_timestamp << std::endl;
     }
 
+    {
+        // rows loaded from --map-db-in are already there when the map is saved over its input,
+        // otherwise they are carried over to the new database
+        std::error_code ec;
+        const bool is_same_db = !map_db_path_in->value().empty() && fs::equivalent(map_db_path_in->value(), map_db_path_out->value(), ec);
+        const size_t groups_from = is_same_db ? num_loaded_groups : 0;
+        const size_t videos_from = is_same_db ? num_loaded_videos : 0;
+
+        const auto tp_metadata = std::chrono::steady_clock::now();
+        metadata_db_writer metadata_writer(db, metadata_wal->is_set());
+        if (!metadata_writer.write(timestamp_group_list, video_timestamps_list, groups_from, videos_from)) {
+            sqlite3_close(db);
+            return EXIT_FAILURE;
+        }
+        const auto metadata_time = std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - tp_metadata).count();
+        spdlog::info("Saved {} timestamp groups and {} videos in {}[s]",
+                     timestamp_group_list.size() - groups_from, video_timestamps_list.size() - videos_from, metadata_time);
+    }
+
     sqlite3_close(db);
     
 
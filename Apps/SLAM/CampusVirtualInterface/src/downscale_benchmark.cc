@@ -0,0 +1,141 @@
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/core/mat.hpp>
+#include <opencv2/core/types.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+#include <spdlog/spdlog.h>
+#include <popl.hpp>
+
+#include "util/equirect_downscale.hpp"
+
+double time_downscale(const cv::Mat& src, cv::Mat& dst, const cv::Size& dst_size,
+                      const downscale_method_t method, const unsigned int iterations) {
+    // warm up, so the destination allocation is not timed
+    downscale_frame(src, dst, dst_size, method);
+
+    const auto tp_1 = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < iterations; ++i) {
+        downscale_frame(src, dst, dst_size, method);
+    }
+    const auto tp_2 = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(tp_2 - tp_1).count() / iterations;
+}
+
+// Frames per second of decoding the video and downscaling every frame to dst_size, as the campus_virtual decoder
+// and resize stages do for each tracking input: "bgr" tracks on colour, "gray" converts after the downscale
+// as with --picture-dir, and "luma" takes the decoder's Y plane as without it
+double decode_resize_fps(const std::string& video_path, const std::string& input, const cv::Size& dst_size,
+                         const downscale_method_t method, const unsigned int max_frames) {
+    cv::VideoCapture video(video_path, cv::CAP_FFMPEG);
+    if (!video.isOpened()) {
+        return 0.0;
+    }
+    if (input == "luma" && !video.set(cv::CAP_PROP_CONVERT_RGB, false)) {
+        std::cerr << "This OpenCV cannot hand over the luma plane, decoding BGR" << std::endl;
+    }
+    cv::Mat frame, downsized, downsized_colour;
+    unsigned int num_frames = 0;
+    const auto tp_1 = std::chrono::steady_clock::now();
+    while (num_frames < max_frames && video.read(frame)) {
+        if (input == "gray" || (input == "luma" && frame.channels() == 3)) {
+            downscale_frame(frame, downsized_colour, dst_size, method);
+            cv::cvtColor(downsized_colour, downsized, cv::COLOR_BGR2GRAY);
+        }
+        else {
+            downscale_frame(frame, downsized, dst_size, method);
+        }
+        ++num_frames;
+    }
+    const auto tp_2 = std::chrono::steady_clock::now();
+    return num_frames / std::chrono::duration_cast<std::chrono::duration<double>>(tp_2 - tp_1).count();
+}
+
+int main(int argc, char* argv[]) {
+    // create options
+    popl::OptionParser op("Allowed options");
+    auto help = op.add<popl::Switch>("h", "help", "produce help message");
+    auto img_path = op.add<popl::Value<std::string>>("i", "image", "equirectangular frame to downscale (random noise if not set)", "");
+    auto src_width = op.add<popl::Value<unsigned int>>("", "width", "width of the random frame", 5760);
+    auto src_height = op.add<popl::Value<unsigned int>>("", "height", "height of the random frame", 2880);
+    auto iterations = op.add<popl::Value<unsigned int>>("n", "iterations", "downscales per method and size", 50);
+    auto grayscale = op.add<popl::Switch>("", "grayscale", "downscale a grayscale frame instead of BGR");
+    auto video_path = op.add<popl::Value<std::string>>("", "video", "time decoding and downscaling this video to 1920x960 per tracking input instead", "");
+    auto max_frames = op.add<popl::Value<unsigned int>>("", "frames", "frames decoded per tracking input with --video", 300);
+
+    try {
+        op.parse(argc, argv);
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        std::cerr << std::endl;
+        std::cerr << op << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (help->is_set()) {
+        std::cerr << op << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (!video_path->value().empty()) {
+        for (const std::string input : {"bgr", "gray", "luma"}) {
+            const double fps = decode_resize_fps(video_path->value(), input, cv::Size(1920, 960), downscale_method_t::LINEAR, max_frames->value());
+            if (fps == 0.0) {
+                std::cerr << "Unable to open the video." << std::endl;
+                return EXIT_FAILURE;
+            }
+            std::cout << input << " - decode+resize: " << fps << " fps" << std::endl;
+        }
+        return 0;
+    }
+
+    cv::Mat src;
+    if (!img_path->value().empty()) {
+        src = cv::imread(img_path->value(), grayscale->is_set() ? cv::IMREAD_GRAYSCALE : cv::IMREAD_COLOR);
+        if (src.empty()) {
+            std::cerr << "Unable to read the image." << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    else {
+        src.create(src_height->value(), src_width->value(), grayscale->is_set() ? CV_8UC1 : CV_8UC3);
+        cv::randu(src, cv::Scalar::all(0), cv::Scalar::all(255));
+    }
+
+#if defined(__AVX2__)
+    const std::string simd = "AVX2";
+#elif defined(__ARM_NEON)
+    const std::string simd = "NEON";
+#else
+    const std::string simd = "scalar";
+#endif
+    std::cout << "Source: " << src.cols << "x" << src.rows << "x" << src.channels() << " - equirect kernel: " << simd << std::endl;
+
+    const std::vector<cv::Size> targets{cv::Size(1920, 960), cv::Size(2880, 1440), cv::Size(960, 480)};
+    for (const auto& target : targets) {
+        cv::Mat linear, area, equirect;
+        const double linear_ms = time_downscale(src, linear, target, downscale_method_t::LINEAR, iterations->value());
+        const double area_ms = time_downscale(src, area, target, downscale_method_t::AREA, iterations->value());
+        const double equirect_ms = time_downscale(src, equirect, target, downscale_method_t::EQUIRECT, iterations->value());
+
+        // the equirect kernel should reproduce INTER_AREA up to rounding
+        double max_diff = 0.0;
+        cv::Mat diff;
+        cv::absdiff(area, equirect, diff);
+        cv::minMaxLoc(diff.reshape(1), nullptr, &max_diff);
+
+        std::cout << target.width << "x" << target.height
+                  << " - linear: " << linear_ms << "[ms]"
+                  << " - area: " << area_ms << "[ms]"
+                  << " - equirect: " << equirect_ms << "[ms]"
+                  << " - max diff to area: " << max_diff << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,98 @@
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <string>
+
+#include <spdlog/spdlog.h>
+#include <popl.hpp>
+
+#include "util/nav_ch.hpp"
+#include "util/nav_graph.hpp"
+#include "util/nav_path.hpp"
+
+// Offline stage run after slam_to_pg --graph-out: contracts the navigation graph into a hierarchy file
+// that nav_route --ch answers queries from.
+
+int main(int argc, char* argv[]) {
+    // create options
+    popl::OptionParser op("Allowed options");
+    auto help = op.add<popl::Switch>("h", "help", "produce help message");
+    auto graph_path = op.add<popl::Value<std::string>>("g", "graph", "navigation graph file written by slam_to_pg --graph-out");
+    auto ch_path = op.add<popl::Value<std::string>>("o", "output", "contraction hierarchy file to write");
+    auto witness_limit = op.add<popl::Value<unsigned int>>("", "witness-limit", "nodes settled per witness search, fewer builds faster but adds shortcuts", 500);
+    auto verify = op.add<popl::Value<unsigned int>>("", "verify", "compare this many routes between random keyframes against A* on the graph", 0);
+    auto log_level = op.add<popl::Value<std::string>>("", "log-level", "log level", "info");
+
+    try {
+        op.parse(argc, argv);
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        std::cerr << std::endl;
+        std::cerr << op << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (help->is_set()) {
+        std::cerr << op << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (!graph_path->is_set() || !ch_path->is_set()) {
+        std::cerr << "invalid arguments" << std::endl;
+        std::cerr << std::endl;
+        std::cerr << op << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    spdlog::set_pattern("[%Y-%m-%d %H:%M:%S.%e] %^[%L] %v%$");
+    spdlog::set_level(spdlog::level::from_str(log_level->value()));
+
+    const nav_graph graph(graph_path->value());
+    if (!graph.is_open()) {
+        return EXIT_FAILURE;
+    }
+
+    const auto tp_1 = std::chrono::steady_clock::now();
+    nav_ch_builder builder(graph, witness_limit->value());
+    nav_ch_builder::build_stats stats;
+    if (!builder.build(ch_path->value(), stats)) {
+        return EXIT_FAILURE;
+    }
+    const auto tp_2 = std::chrono::steady_clock::now();
+    const auto elapsed = std::chrono::duration_cast<std::chrono::duration<double>>(tp_2 - tp_1).count();
+    spdlog::info("Contracted {} nodes and {} edges in {}[s]: {} shortcuts, {} upward edges written to {}",
+                 graph.num_nodes(), graph.num_edges(), elapsed, stats.num_shortcuts, stats.num_up_edges, ch_path->value());
+
+    if (verify->value() == 0 || graph.num_nodes() == 0) {
+        return 0;
+    }
+    const nav_ch ch(ch_path->value(), graph);
+    if (!ch.is_open()) {
+        return EXIT_FAILURE;
+    }
+    nav_path_engine engine(graph);
+    nav_ch_query query(ch);
+    std::mt19937 rng(0);
+    std::uniform_int_distribution<uint32_t> node(0, graph.num_nodes() - 1);
+    unsigned int num_mismatches = 0;
+    for (unsigned int i = 0; i < verify->value(); ++i) {
+        const auto from = node(rng);
+        const auto to = node(rng);
+        const auto expected = engine.find_path(from, to);
+        const auto route = query.find_path(from, to);
+        const bool same = expected.nodes.empty() == route.nodes.empty()
+                          && std::abs(expected.distance - route.distance) <= 1e-9 * (1.0 + expected.distance);
+        if (!same) {
+            spdlog::warn("Route {} -> {} is {} long on the hierarchy and {} on the graph",
+                         graph.id(from), graph.id(to), route.distance, expected.distance);
+            ++num_mismatches;
+        }
+    }
+    if (num_mismatches != 0) {
+        spdlog::error("{} of {} routes differ from the graph", num_mismatches, verify->value());
+        return EXIT_FAILURE;
+    }
+    spdlog::info("{} routes match the graph", verify->value());
+    return 0;
+}
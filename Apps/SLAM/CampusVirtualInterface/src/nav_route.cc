@@ -0,0 +1,144 @@
+#include <iostream>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+#include <spdlog/spdlog.h>
+#include <popl.hpp>
+
+#include "util/nav_ch.hpp"
+#include "util/nav_graph.hpp"
+#include "util/nav_path.hpp"
+
+// Answers route queries over the navigation graph written by slam_to_pg --graph-out.
+// With --ch, routes without a location to stop at are answered from the contraction hierarchy written by nav_contract.
+// Queries are keyframe ids, routes are printed as one JSON object per line:
+// {"from": .., "to": .., "path": [keyframe ids], "distance": .., "expanded": ..}
+
+nlohmann::json route_query(const nav_graph& graph, nav_path_engine& engine, nav_ch_query* ch_query,
+                           const unsigned int from_id, const unsigned int to_id, const std::string& first_with) {
+    nlohmann::json result{{"from", from_id}, {"to", to_id}, {"path", nlohmann::json::array()}};
+    const auto from = graph.find(from_id);
+    const auto to = graph.find(to_id);
+    if (from == nav_graph::npos || to == nav_graph::npos) {
+        result["error"] = "unknown keyframe id";
+        return result;
+    }
+    const auto location = first_with.empty() ? nav_graph::npos : graph.find_location(first_with);
+
+    const auto route = ch_query && location == nav_graph::npos ? ch_query->find_path(from, to)
+                                                               : engine.find_path(from, to, location);
+    for (const auto node : route.nodes) {
+        result["path"].push_back(graph.id(node));
+    }
+    result["distance"] = route.distance;
+    result["expanded"] = route.num_expanded;
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    // create options
+    popl::OptionParser op("Allowed options");
+    auto help = op.add<popl::Switch>("h", "help", "produce help message");
+    auto graph_path = op.add<popl::Value<std::string>>("g", "graph", "navigation graph file written by slam_to_pg --graph-out");
+    auto from = op.add<popl::Value<unsigned int>>("", "from", "keyframe id the route starts at");
+    auto to = op.add<popl::Value<unsigned int>>("", "to", "keyframe id the route ends at");
+    auto ch_path = op.add<popl::Value<std::string>>("", "ch", "contraction hierarchy file written by nav_contract");
+    auto first_with = op.add<popl::Value<std::string>>("", "first-with", "stop at the first keyframe found with this location", "");
+    auto read_stdin = op.add<popl::Switch>("", "stdin", "answer queries read from stdin, one \"from to [location]\" per line");
+    auto benchmark = op.add<popl::Value<unsigned int>>("", "benchmark", "time this many routes between random keyframes and exit", 0);
+    auto log_level = op.add<popl::Value<std::string>>("", "log-level", "log level", "warn");
+
+    try {
+        op.parse(argc, argv);
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        std::cerr << std::endl;
+        std::cerr << op << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (help->is_set()) {
+        std::cerr << op << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (!graph_path->is_set() || (!read_stdin->is_set() && benchmark->value() == 0 && (!from->is_set() || !to->is_set()))) {
+        std::cerr << "invalid arguments" << std::endl;
+        std::cerr << std::endl;
+        std::cerr << op << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    spdlog::set_pattern("[%Y-%m-%d %H:%M:%S.%e] %^[%L] %v%$");
+    spdlog::set_level(spdlog::level::from_str(log_level->value()));
+
+    const nav_graph graph(graph_path->value());
+    if (!graph.is_open()) {
+        return EXIT_FAILURE;
+    }
+    nav_path_engine engine(graph);
+    std::unique_ptr<nav_ch> ch;
+    std::unique_ptr<nav_ch_query> ch_query;
+    if (ch_path->is_set()) {
+        ch.reset(new nav_ch(ch_path->value(), graph));
+        if (!ch->is_open()) {
+            return EXIT_FAILURE;
+        }
+        ch_query.reset(new nav_ch_query(*ch));
+    }
+
+    if (benchmark->value() != 0) {
+        if (graph.num_nodes() == 0) {
+            std::cerr << "The navigation graph is empty" << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::mt19937 rng(0);
+        std::uniform_int_distribution<uint32_t> node(0, graph.num_nodes() - 1);
+        std::vector<std::pair<uint32_t, uint32_t>> queries(benchmark->value());
+        for (auto& query : queries) {
+            query = {node(rng), node(rng)};
+        }
+
+        unsigned long num_found = 0, num_expanded = 0;
+        const auto tp_1 = std::chrono::steady_clock::now();
+        for (const auto& query : queries) {
+            const auto route = ch_query ? ch_query->find_path(query.first, query.second)
+                                        : engine.find_path(query.first, query.second);
+            num_found += !route.nodes.empty();
+            num_expanded += route.num_expanded;
+        }
+        const auto tp_2 = std::chrono::steady_clock::now();
+        const auto elapsed = std::chrono::duration_cast<std::chrono::duration<double>>(tp_2 - tp_1).count();
+
+        std::cout << graph.num_nodes() << " nodes, " << graph.num_edges() << " edges - "
+                  << queries.size() << " routes in " << elapsed << "[s] - "
+                  << queries.size() / elapsed << " routes/s, "
+                  << num_found << " found, " << num_expanded / queries.size() << " nodes expanded on average" << std::endl;
+        return 0;
+    }
+
+    if (read_stdin->is_set()) {
+        std::string line;
+        while (std::getline(std::cin, line)) {
+            std::istringstream query(line);
+            unsigned int from_id, to_id;
+            std::string location;
+            if (!(query >> from_id >> to_id)) {
+                std::cout << nlohmann::json{{"error", "expected \"from to [location]\""}}.dump() << std::endl;
+                continue;
+            }
+            std::getline(query >> std::ws, location);
+            std::cout << route_query(graph, engine, ch_query.get(), from_id, to_id, location).dump() << std::endl;
+        }
+        return 0;
+    }
+
+    const auto result = route_query(graph, engine, ch_query.get(), from->value(), to->value(), first_with->value());
+    std::cout << result.dump() << std::endl;
+    return result.contains("error") ? EXIT_FAILURE : 0;
+}
@@ -0,0 +1,217 @@
+#include "stella_vslam/util/string.h"
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <spdlog/spdlog.h>
+#include <popl.hpp>
+#include <nlohmann/json.hpp>
+#include <yaml-cpp/yaml.h>
+
+#include <ghc/filesystem.hpp>
+namespace fs = ghc::filesystem;
+
+// Runs campus_virtual once per resolution and frame skip, each in its own process so the peak RSS is per run,
+// and collects the tracking summary and track times it leaves in --eval-log-dir into one JSON report
+
+double percentile(const std::vector<double>& sorted_values, const double p) {
+    if (sorted_values.empty()) {
+        return 0.0;
+    }
+    const auto rank = static_cast<size_t>(std::ceil(p / 100.0 * sorted_values.size()));
+    return sorted_values.at(std::min(sorted_values.size() - 1, rank == 0 ? 0 : rank - 1));
+}
+
+std::vector<double> load_track_times(const std::string& path) {
+    std::vector<double> track_times;
+    std::ifstream ifs(path);
+    double track_time;
+    while (ifs >> track_time) {
+        track_times.push_back(track_time);
+    }
+    return track_times;
+}
+
+// Returns the exit status of campus_virtual, the peak RSS [KiB] is written to max_rss_kb
+int run_campus_virtual(const std::vector<std::string>& args, const std::string& log_path, long& max_rss_kb) {
+    std::vector<char*> argv;
+    for (const auto& arg : args) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    const pid_t pid = fork();
+    if (pid < 0) {
+        spdlog::error("Failed to fork campus_virtual");
+        return -1;
+    }
+    if (pid == 0) {
+        const int log_fd = open(log_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (0 <= log_fd) {
+            dup2(log_fd, STDOUT_FILENO);
+            dup2(log_fd, STDERR_FILENO);
+            close(log_fd);
+        }
+        execv(argv[0], argv.data());
+        std::cerr << "Failed to run " << argv[0] << std::endl;
+        _exit(127);
+    }
+
+    int status = 0;
+    struct rusage usage {};
+    if (wait4(pid, &status, 0, &usage) < 0) {
+        spdlog::error("Failed to wait for campus_virtual");
+        return -1;
+    }
+    max_rss_kb = usage.ru_maxrss;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+int main(int argc, char* argv[]) {
+    // create options
+    popl::OptionParser op("Allowed options");
+    auto help = op.add<popl::Switch>("h", "help", "produce help message");
+    auto campus_virtual_path = op.add<popl::Value<std::string>>("", "campus-virtual", "campus_virtual executable", "./campus_virtual");
+    auto vocab_file_path = op.add<popl::Value<std::string>>("v", "vocab", "vocabulary file path");
+    auto config_file_path = op.add<popl::Value<std::string>>("c", "config", "config file path, Camera cols/rows are overridden per run");
+    auto video_file_path = op.add<popl::Value<std::string>>("", "video", "video to track");
+    auto resolutions = op.add<popl::Value<std::string>>("", "resolutions", "comma separated SLAM resolutions", "960x480,1920x960,2880x1440");
+    auto frame_skips = op.add<popl::Value<std::string>>("", "frame-skips", "comma separated frame skips", "1");
+    auto work_dir = op.add<popl::Value<std::string>>("", "work-dir", "directory for the per run configs and eval logs", "sweep");
+    auto picture_dir = op.add<popl::Value<std::string>>("p", "picture-dir", "keyframe img snapshot directory passed to campus_virtual (none if empty)", "");
+    auto output = op.add<popl::Value<std::string>>("o", "output", "JSON report path (stdout if empty)", "");
+    auto log_level = op.add<popl::Value<std::string>>("", "log-level", "log level", "info");
+
+    try {
+        op.parse(argc, argv);
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        std::cerr << std::endl;
+        std::cerr << op << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // check validness of options
+    if (help->is_set()) {
+        std::cerr << op << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (!vocab_file_path->is_set() || !config_file_path->is_set() || !video_file_path->is_set()) {
+        std::cerr << "invalid arguments" << std::endl;
+        std::cerr << std::endl;
+        std::cerr << op << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // setup logger
+    spdlog::set_pattern("[%Y-%m-%d %H:%M:%S.%e] %^[%L] %v%$");
+    spdlog::set_level(spdlog::level::from_str(log_level->value()));
+
+    YAML::Node base_config;
+    try {
+        base_config = YAML::LoadFile(config_file_path->value());
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    nlohmann::json report = nlohmann::json::array();
+    for (const auto& resolution : stella_vslam::util::split_string(resolutions->value(), ',')) {
+        unsigned int cols = 0;
+        unsigned int rows = 0;
+        if (std::sscanf(resolution.c_str(), "%ux%u", &cols, &rows) != 2) {
+            std::cerr << "invalid resolution: " << resolution << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        for (const auto& frame_skip : stella_vslam::util::split_string(frame_skips->value(), ',')) {
+            const auto run_dir = fs::path(work_dir->value()) / (resolution + "_skip" + frame_skip);
+            fs::create_directories(run_dir);
+
+            YAML::Node run_config = YAML::Clone(base_config);
+            run_config["Camera"]["cols"] = cols;
+            run_config["Camera"]["rows"] = rows;
+            const auto run_config_path = (run_dir / "config.yaml").string();
+            std::ofstream ofs_config(run_config_path);
+            ofs_config << run_config << std::endl;
+            ofs_config.close();
+
+            const std::vector<std::string> args{
+                campus_virtual_path->value(),
+                "-v", vocab_file_path->value(),
+                "-c", run_config_path,
+                "--videos", video_file_path->value(),
+                "--frame-skip", frame_skip,
+                "--no-sleep",
+                "--viewer", "none",
+                "-t", "0",
+                "-p", picture_dir->value(),
+                "--eval-log-dir", run_dir.string(),
+                "--log-level", log_level->value()};
+
+            // the run directory is reused between sweeps, a run that ends early must not report the previous one's results
+            fs::remove(run_dir / "tracking_summary.json");
+            fs::remove(run_dir / "track_times.txt");
+
+            spdlog::info("Running {} with frame skip {}", resolution, frame_skip);
+            long max_rss_kb = 0;
+            const int exit_status = run_campus_virtual(args, (run_dir / "campus_virtual.log").string(), max_rss_kb);
+
+            nlohmann::json entry = nlohmann::json::object();
+            std::ifstream ifs_summary((run_dir / "tracking_summary.json").string());
+            if (ifs_summary.good()) {
+                entry = nlohmann::json::parse(ifs_summary, nullptr, false);
+                if (entry.is_discarded() || !entry.is_object()) {
+                    spdlog::warn("Unreadable tracking summary for {} with frame skip {}, see {}", resolution, frame_skip, (run_dir / "campus_virtual.log").string());
+                    entry = nlohmann::json::object();
+                }
+            }
+            else {
+                spdlog::warn("No tracking summary for {} with frame skip {}, see {}", resolution, frame_skip, (run_dir / "campus_virtual.log").string());
+            }
+
+            auto track_times = load_track_times((run_dir / "track_times.txt").string());
+            std::sort(track_times.begin(), track_times.end());
+            const auto total_track_time = std::accumulate(track_times.begin(), track_times.end(), 0.0);
+
+            entry["resolution"] = resolution;
+            entry["frame_skip"] = std::stoi(frame_skip);
+            entry["exit_status"] = exit_status;
+            entry["peak_rss_kb"] = max_rss_kb;
+            entry["track_time"] = {
+                {"mean", track_times.empty() ? 0.0 : total_track_time / track_times.size()},
+                {"median", percentile(track_times, 50)},
+                {"p95", percentile(track_times, 95)},
+                {"p99", percentile(track_times, 99)},
+                {"max", track_times.empty() ? 0.0 : track_times.back()}};
+            report.push_back(entry);
+
+            spdlog::info("{} skip {}: {} fps, median track time {}[s], {} keyframes, peak RSS {} KiB",
+                         resolution, frame_skip, entry.value("fps", 0.0), percentile(track_times, 50),
+                         entry.value("num_keyframes", 0u), max_rss_kb);
+        }
+    }
+
+    if (output->value().empty()) {
+        std::cout << report.dump(4) << std::endl;
+    }
+    else {
+        std::ofstream ofs(output->value());
+        ofs << report.dump(4) << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,217 @@
+#include "stella_vslam/system.h"
+#include "stella_vslam/config.h"
+
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+#include <popl.hpp>
+
+#include "util/map_db_reader.hpp"
+#include "util/mapped_file.hpp"
+#include "util/nav_graph.hpp"
+#include "util/page_cache.hpp"
+
+// Times the startup of the CampusVirtual executables. campus_virtual and campus_virtual_viewer build a
+// stella_vslam::system from the vocabulary, load the map database and start the system; slam_to_pg reads the
+// keyframes and graph of the map database with map_db_reader, without a vocabulary or a system.
+//
+// The vocabulary cannot be shared between the tools: stella_vslam::system only takes a path and reads and parses
+// the .fbow file into its own heap, so sharing it needs a stella_vslam API that accepts the vocabulary from memory.
+// The stella_vslam startups are also timed with a readahead hint, the .fbow file mapped with MADV_WILLNEED before
+// the system is built, which can only start the disk read earlier. No tool uses the hint, this measures what it
+// would be worth.
+
+struct startup_times {
+    double system = 0.0; // stella_vslam::system construction, i.e. the vocabulary load
+    double map = 0.0;    // load_map_database
+    double startup = 0.0;
+    double total = 0.0;
+};
+
+double seconds_since(const std::chrono::steady_clock::time_point& tp) {
+    return std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - tp).count();
+}
+
+bool time_startup(const std::shared_ptr<stella_vslam::config>& cfg,
+                  const std::string& vocab_file_path,
+                  const std::string& map_db_path,
+                  const bool enable_mapping,
+                  const bool readahead_vocabulary,
+                  startup_times& times) {
+    const auto tp_start = std::chrono::steady_clock::now();
+    std::unique_ptr<mapped_file> vocab_readahead;
+    if (readahead_vocabulary) {
+        vocab_readahead.reset(new mapped_file(vocab_file_path));
+    }
+
+    auto tp = std::chrono::steady_clock::now();
+    auto slam = std::make_shared<stella_vslam::system>(cfg, vocab_file_path);
+    times.system = seconds_since(tp);
+
+    tp = std::chrono::steady_clock::now();
+    if (!map_db_path.empty() && !slam->load_map_database(map_db_path)) {
+        return false;
+    }
+    times.map = seconds_since(tp);
+
+    tp = std::chrono::steady_clock::now();
+    slam->startup(map_db_path.empty());
+    if (!enable_mapping) {
+        slam->disable_mapping_module();
+    }
+    times.startup = seconds_since(tp);
+    times.total = seconds_since(tp_start);
+
+    slam->shutdown();
+    return true;
+}
+
+// slam_to_pg's map read: the keyframe pass and the graph pass over the map database
+bool time_map_read(const std::string& map_db_path, startup_times& times) {
+    const auto tp_start = std::chrono::steady_clock::now();
+    nav_graph_builder graph;
+    {
+        map_db_reader reader(map_db_path);
+        if (!reader.for_each_keyframe([&graph](const map_keyframe& keyfrm) {
+                graph.add_node(keyfrm);
+            })) {
+            return false;
+        }
+    }
+    {
+        map_db_reader reader(map_db_path);
+        const bool ok = reader.for_each_keyframe([&graph](const map_keyframe& keyfrm) {
+            for (const auto child_id : keyfrm.spanning_children) {
+                graph.add_edge(keyfrm.id, child_id, 0);
+            }
+            if (0 <= keyfrm.span_parent) {
+                graph.add_edge(keyfrm.id, static_cast<unsigned int>(keyfrm.span_parent), 0);
+            }
+            for (const auto loop_id : keyfrm.loop_edges) {
+                graph.add_edge(keyfrm.id, loop_id, 1);
+            }
+        });
+        if (!ok) {
+            return false;
+        }
+    }
+    times.map = seconds_since(tp_start);
+    times.total = times.map;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    // create options
+    popl::OptionParser op("Allowed options");
+    auto help = op.add<popl::Switch>("h", "help", "produce help message");
+    auto vocab_file_path = op.add<popl::Value<std::string>>("v", "vocab", "vocabulary file path");
+    auto config_file_path = op.add<popl::Value<std::string>>("c", "config", "config file path");
+    auto map_db_path = op.add<popl::Value<std::string>>("i", "map-db-in", "map database read by slam_to_pg and loaded by campus_virtual_viewer", "");
+    auto iterations = op.add<popl::Value<unsigned int>>("n", "iterations", "startups per executable and mode", 3);
+    auto cold = op.add<popl::Switch>("", "cold", "drop the vocabulary and map from the page cache before every startup");
+    auto log_level = op.add<popl::Value<std::string>>("", "log-level", "log level", "warn");
+
+    try {
+        op.parse(argc, argv);
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        std::cerr << std::endl;
+        std::cerr << op << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (help->is_set()) {
+        std::cerr << op << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (!vocab_file_path->is_set() || !config_file_path->is_set()) {
+        std::cerr << "invalid arguments" << std::endl;
+        std::cerr << std::endl;
+        std::cerr << op << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    spdlog::set_pattern("[%Y-%m-%d %H:%M:%S.%e] %^[%L] %v%$");
+    spdlog::set_level(spdlog::level::from_str(log_level->value()));
+
+    std::shared_ptr<stella_vslam::config> cfg;
+    try {
+        cfg = std::make_shared<stella_vslam::config>(config_file_path->value());
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    {
+        if (cold->is_set()) {
+            evict_from_page_cache(vocab_file_path->value());
+        }
+        const mapped_file vocab_mapping(vocab_file_path->value());
+        const auto tp = std::chrono::steady_clock::now();
+        const auto num_pages = vocab_mapping.touch();
+        std::cout << "Vocabulary: " << vocab_mapping.size() << " bytes, " << num_pages << " pages faulted in "
+                  << seconds_since(tp) << "[s]" << std::endl;
+    }
+
+    // campus_virtual starts with mapping enabled, and without a map for the first video;
+    // campus_virtual_viewer loads the map and disables mapping
+    struct executable_profile {
+        std::string name;
+        std::string map_db_path;
+        bool enable_mapping;
+    };
+    const std::vector<executable_profile> profiles{
+        {"campus_virtual", "", true},
+        {"campus_virtual_viewer", map_db_path->value(), false}};
+
+    for (const auto& profile : profiles) {
+        for (const bool readahead_vocabulary : {false, true}) {
+            std::vector<double> totals;
+            startup_times times;
+            for (unsigned int i = 0; i < std::max(1u, iterations->value()); ++i) {
+                if (cold->is_set()) {
+                    evict_from_page_cache(vocab_file_path->value());
+                    if (!profile.map_db_path.empty()) {
+                        evict_from_page_cache(profile.map_db_path);
+                    }
+                }
+                if (!time_startup(cfg, vocab_file_path->value(), profile.map_db_path, profile.enable_mapping, readahead_vocabulary, times)) {
+                    std::cerr << "Unable to load the map database." << std::endl;
+                    return EXIT_FAILURE;
+                }
+                totals.push_back(times.total);
+            }
+            std::sort(totals.begin(), totals.end());
+            std::cout << profile.name << (readahead_vocabulary ? " (vocabulary readahead)" : "")
+                      << " - median startup: " << totals.at(totals.size() / 2) << "[s]"
+                      << " - last run: system " << times.system << "[s], map " << times.map << "[s], startup " << times.startup << "[s]"
+                      << std::endl;
+        }
+    }
+
+    if (!map_db_path->value().empty()) {
+        std::vector<double> totals;
+        startup_times times;
+        for (unsigned int i = 0; i < std::max(1u, iterations->value()); ++i) {
+            if (cold->is_set()) {
+                evict_from_page_cache(map_db_path->value());
+            }
+            if (!time_map_read(map_db_path->value(), times)) {
+                std::cerr << "Unable to read the map database." << std::endl;
+                return EXIT_FAILURE;
+            }
+            totals.push_back(times.total);
+        }
+        std::sort(totals.begin(), totals.end());
+        std::cout << "slam_to_pg - median map read: " << totals.at(totals.size() / 2) << "[s]" << std::endl;
+    }
+
+    return 0;
+}
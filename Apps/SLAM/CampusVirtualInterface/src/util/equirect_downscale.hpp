@@ -0,0 +1,142 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <opencv2/core/mat.hpp>
+#include <opencv2/imgproc.hpp>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+enum class downscale_method_t {
+    LINEAR,    // cv::resize INTER_LINEAR, the original behaviour
+    AREA,      // cv::resize INTER_AREA
+    EQUIRECT   // integer factor box filter below, INTER_AREA otherwise
+};
+
+inline downscale_method_t downscale_method_from_string(const std::string& method) {
+    if (method == "linear") {
+        return downscale_method_t::LINEAR;
+    }
+    if (method == "area") {
+        return downscale_method_t::AREA;
+    }
+    if (method == "equirect") {
+        return downscale_method_t::EQUIRECT;
+    }
+    throw std::invalid_argument("Invalid resize method: " + method + " (expected linear, area or equirect)");
+}
+
+namespace equirect_downscale {
+
+// Add one row of 8-bit samples onto the 16-bit column sums
+inline void accumulate_row(const uint8_t* src, uint16_t* sums, const int num_samples) {
+    int i = 0;
+#if defined(__AVX2__)
+    for (; i + 16 <= num_samples; i += 16) {
+        const __m256i samples = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)));
+        const __m256i acc = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(sums + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(sums + i), _mm256_add_epi16(acc, samples));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 8 <= num_samples; i += 8) {
+        vst1q_u16(sums + i, vaddw_u8(vld1q_u16(sums + i), vld1_u8(src + i)));
+    }
+#endif
+    for (; i < num_samples; ++i) {
+        sums[i] += src[i];
+    }
+}
+
+// Divide factor_x neighbouring column sums of every channel by the block area
+template<int channels>
+inline void reduce_columns(const uint16_t* sums, uint8_t* dst_row, const int dst_cols, const int factor_x, const uint32_t inv_area) {
+    for (int x = 0; x < dst_cols; ++x) {
+        uint32_t sum[channels] = {};
+        for (int kx = 0; kx < factor_x; ++kx) {
+            for (int c = 0; c < channels; ++c) {
+                sum[c] += sums[kx * channels + c];
+            }
+        }
+        for (int c = 0; c < channels; ++c) {
+            dst_row[x * channels + c] = static_cast<uint8_t>(std::min(255u, (sum[c] * inv_area + 32768u) >> 16));
+        }
+        sums += factor_x * channels;
+    }
+}
+
+// Box filter an 8-bit interleaved image (1 or 3 channels) down by integer factors.
+// Every output pixel is the rounded mean of a factor_x x factor_y block, which is what INTER_AREA computes for integer
+// ratios. Rows are summed into 16-bit accumulators with SIMD, so factor_y must stay <= 257.
+inline void area_downscale_u8(const uint8_t* src, const size_t src_step,
+                              const int dst_cols, const int dst_rows, const int channels,
+                              uint8_t* dst, const size_t dst_step,
+                              const int factor_x, const int factor_y) {
+    const int num_samples = dst_cols * factor_x * channels;
+    const uint32_t area = static_cast<uint32_t>(factor_x * factor_y);
+    // fixed point reciprocal, (sum * inv_area) >> 16 is within one level of sum / area
+    const uint32_t inv_area = (65536u + area / 2) / area;
+
+    std::vector<uint16_t> sums(num_samples);
+    for (int y = 0; y < dst_rows; ++y) {
+        std::fill(sums.begin(), sums.end(), 0);
+        for (int ky = 0; ky < factor_y; ++ky) {
+            accumulate_row(src + (static_cast<size_t>(y) * factor_y + ky) * src_step, sums.data(), num_samples);
+        }
+
+        uint8_t* dst_row = dst + static_cast<size_t>(y) * dst_step;
+        if (channels == 3) {
+            reduce_columns<3>(sums.data(), dst_row, dst_cols, factor_x, inv_area);
+        }
+        else {
+            reduce_columns<1>(sums.data(), dst_row, dst_cols, factor_x, inv_area);
+        }
+    }
+}
+
+// Integer factor for src -> dst if the ratio is within tolerance of one, 0 otherwise
+inline int integer_factor(const int src, const int dst, const double tolerance = 0.01) {
+    if (dst <= 0 || src < dst) {
+        return 0;
+    }
+    const int factor = static_cast<int>(std::lround(static_cast<double>(src) / dst));
+    if (factor < 1 || src < factor * dst) {
+        return 0;
+    }
+    // near integer ratios lose the few surplus columns/rows at the edges of the panorama
+    return (src - factor * dst) <= tolerance * src ? factor : 0;
+}
+
+} // namespace equirect_downscale
+
+// Downscale to the SLAM resolution. dst must already have the target size when it is a preallocated buffer.
+inline void downscale_frame(const cv::Mat& src, cv::Mat& dst, const cv::Size& dst_size, const downscale_method_t method) {
+    if (method == downscale_method_t::LINEAR) {
+        cv::resize(src, dst, dst_size, 0, 0, cv::INTER_LINEAR);
+        return;
+    }
+
+    const int factor_x = equirect_downscale::integer_factor(src.cols, dst_size.width);
+    const int factor_y = equirect_downscale::integer_factor(src.rows, dst_size.height);
+    if (method == downscale_method_t::AREA || src.depth() != CV_8U || (src.channels() != 1 && src.channels() != 3)
+        || factor_x == 0 || factor_y == 0 || 257 < factor_y) {
+        cv::resize(src, dst, dst_size, 0, 0, cv::INTER_AREA);
+        return;
+    }
+
+    // centre the used area on the panorama when the ratio is only near integer
+    const cv::Rect roi((src.cols - factor_x * dst_size.width) / 2, (src.rows - factor_y * dst_size.height) / 2,
+                       factor_x * dst_size.width, factor_y * dst_size.height);
+    const cv::Mat src_roi = src(roi);
+    dst.create(dst_size, src.type());
+    equirect_downscale::area_downscale_u8(src_roi.ptr<uint8_t>(), src_roi.step, dst_size.width, dst_size.height, src.channels(),
+                                          dst.ptr<uint8_t>(), dst.step, factor_x, factor_y);
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include <opencv2/core/mat.hpp>
+#include <spdlog/spdlog.h>
+
+#include "bounded_queue.hpp"
+
+// The images one video frame needs on its way through the pipeline
+struct frame_buffer {
+    cv::Mat frame;           // full resolution frame, kept for the keyframe snapshot
+    cv::Mat downsized_frame; // frame at the SLAM resolution
+};
+
+class frame_buffer_pool;
+
+// Hands the buffer back to its pool instead of freeing it
+struct frame_buffer_recycler {
+    frame_buffer_pool* pool = nullptr;
+    void operator()(frame_buffer* buffer) const;
+};
+
+using pooled_frame_buffer = std::unique_ptr<frame_buffer, frame_buffer_recycler>;
+
+// Fixed set of frame buffers allocated up front at the video and SLAM resolutions.
+// The decoder acquires one buffer per frame and it is recycled when the last stage holding it lets go,
+// so steady state ingest performs no large allocations and the pool size caps the memory held by frames.
+// acquire() blocks while every buffer is in flight, which throttles the decoder like a full queue would.
+class frame_buffer_pool {
+public:
+    frame_buffer_pool(const unsigned int num_buffers,
+                      const cv::Size& frame_size, const int frame_type,
+                      const cv::Size& downsized_size, const int downsized_type)
+        : free_buffers_(num_buffers == 0 ? 1 : num_buffers) {
+        for (unsigned int i = 0; i < std::max(1u, num_buffers); ++i) {
+            auto buffer = std::unique_ptr<frame_buffer>(new frame_buffer());
+            buffer->frame.create(frame_size, frame_type);
+            buffer->downsized_frame.create(downsized_size, downsized_type);
+            free_buffers_.push(buffer.get());
+            buffers_.push_back(std::move(buffer));
+        }
+        spdlog::info("Frame buffer pool: {} buffers of {}x{} and {}x{}",
+                     buffers_.size(), frame_size.width, frame_size.height, downsized_size.width, downsized_size.height);
+    }
+
+    frame_buffer_pool(const frame_buffer_pool&) = delete;
+    frame_buffer_pool& operator=(const frame_buffer_pool&) = delete;
+
+    // Returns an empty handle once the pool is closed
+    pooled_frame_buffer acquire() {
+        if (free_buffers_.size() == 0) {
+            ++num_waits_;
+        }
+        frame_buffer* buffer = nullptr;
+        if (!free_buffers_.pop(buffer)) {
+            return pooled_frame_buffer(nullptr, frame_buffer_recycler{this});
+        }
+        return pooled_frame_buffer(buffer, frame_buffer_recycler{this});
+    }
+
+    void recycle(frame_buffer* buffer) {
+        // after close() the buffer simply stays with buffers_ until the pool is destroyed
+        free_buffers_.push(std::move(buffer));
+    }
+
+    // Wakes up a blocked acquire() when the pipeline stops early
+    void close() {
+        free_buffers_.close();
+    }
+
+    unsigned long num_waits() const {
+        return num_waits_;
+    }
+
+private:
+    std::vector<std::unique_ptr<frame_buffer>> buffers_;
+    bounded_queue<frame_buffer*> free_buffers_;
+    std::atomic<unsigned long> num_waits_{0};
+};
+
+inline void frame_buffer_recycler::operator()(frame_buffer* buffer) const {
+    if (buffer && pool) {
+        pool->recycle(buffer);
+    }
+}
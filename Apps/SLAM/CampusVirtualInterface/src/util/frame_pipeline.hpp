@@ -0,0 +1,62 @@
+#pragma once
+
+#include <map>
+#include <utility>
+
+#include "bounded_queue.hpp"
+#include "frame_buffer_pool.hpp"
+#include "equirect_downscale.hpp"
+
+// Queue depths and worker counts for the decode -> resize -> track -> write pipeline in mono_tracking
+struct pipeline_config {
+    unsigned int decode_queue_depth = 8;
+    unsigned int resize_threads = 2;
+    downscale_method_t resize_method = downscale_method_t::LINEAR;
+    unsigned int track_queue_depth = 8;
+    unsigned int writer_threads = 2;
+    unsigned int writer_queue_depth = 16;
+    unsigned int frame_buffers = 16; // frames in flight across all stages
+};
+
+// A decoded video frame travelling through the pipeline
+struct frame_packet {
+    unsigned long seq = 0;       // contiguous index of the packets handed to the tracker
+    unsigned int num_frame = 0;  // index of the frame in the video
+    double ms = 0.0;             // position in the video [milli seconds]
+    double progress = 0.0;       // [%]
+    pooled_frame_buffer buffer;  // full resolution and downsized images
+};
+
+// Resize workers finish out of order; hands packets back in sequence order for the tracker
+class frame_reorder_buffer {
+public:
+    explicit frame_reorder_buffer(bounded_queue<frame_packet>& input)
+        : input_(input) {}
+
+    bool pop(frame_packet& packet) {
+        while (true) {
+            const auto it = pending_.find(next_seq_);
+            if (it != pending_.end()) {
+                packet = std::move(it->second);
+                pending_.erase(it);
+                ++next_seq_;
+                return true;
+            }
+            frame_packet incoming;
+            if (!input_.pop(incoming)) {
+                // Input closed: sequence gaps can only come from an aborted stage, so flush what is left in order
+                if (pending_.empty()) {
+                    return false;
+                }
+                next_seq_ = pending_.begin()->first;
+                continue;
+            }
+            pending_.emplace(incoming.seq, std::move(incoming));
+        }
+    }
+
+private:
+    bounded_queue<frame_packet>& input_;
+    std::map<unsigned long, frame_packet> pending_;
+    unsigned long next_seq_ = 0;
+};
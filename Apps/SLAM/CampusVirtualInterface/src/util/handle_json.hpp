@@ -1,44 +1,234 @@
 #pragma once
 
 #include <nlohmann/json.hpp>
-#include <stdio.h>
 
-nlohmann::json filename_to_json_obj(std::string json_filename, std::string json_dir){
-    nlohmann::json json_obj;
-    std::string full_filepath = json_dir + "/" + json_filename;
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
+#include <spdlog/spdlog.h>
 
-    std::ifstream json_file(full_filepath.c_str());
-    if (!json_file.good()){
-        return NULL;
+// The group timeline of a video, compiled into sorted boundaries and interned group ids.
+// Entry i says the video shows group_names_[group_ids_[i]] from boundaries_[i] milliseconds on,
+// until the next boundary, so finding the group of a frame is a binary search.
+class group_timeline {
+public:
+    // Collect an entry, entries may come in any order and are sorted by compile()
+    void add(const double ms, const std::string& group) {
+        auto it = group_index_.find(group);
+        if (it == group_index_.end()) {
+            it = group_index_.emplace(group, static_cast<uint32_t>(group_names_.size())).first;
+            group_names_.push_back(group);
+        }
+        pending_.emplace_back(ms, it->second);
     }
-    
-    json_file >> json_obj;
 
-    return json_obj;
-}
+    // Sort the collected entries into the lookup arrays. Entries with the same time keep their order,
+    // so the later one wins as it did when the timeline was walked in file order.
+    void compile() {
+        std::stable_sort(pending_.begin(), pending_.end(), [](const std::pair<double, uint32_t>& a, const std::pair<double, uint32_t>& b) {
+            return a.first < b.first;
+        });
+        boundaries_.clear();
+        group_ids_.clear();
+        boundaries_.reserve(pending_.size());
+        group_ids_.reserve(pending_.size());
+        for (const auto& entry : pending_) {
+            boundaries_.push_back(entry.first);
+            group_ids_.push_back(entry.second);
+        }
+        std::vector<std::pair<double, uint32_t>>().swap(pending_);
+        std::unordered_map<std::string, uint32_t>().swap(group_index_);
+    }
+
+    // Group shown at ms into the video, empty before the first entry or for negative times
+    const std::string& lookup(const double ms) const {
+        static const std::string no_group;
+        if (ms < 0) {
+            return no_group;
+        }
+        const auto it = std::upper_bound(boundaries_.begin(), boundaries_.end(), ms);
+        if (it == boundaries_.begin()) {
+            return no_group;
+        }
+        return group_names_[group_ids_[it - boundaries_.begin() - 1]];
+    }
 
-std::string find_group_from_json(nlohmann::json &obj, double &ms){
-    if (ms < 0){
-        return "";
+    void set_name(const std::string& name) {
+        name_ = name;
     }
 
-    double seconds = ms/1000;
+    const std::string& name() const {
+        return name_;
+    }
+
+    size_t num_entries() const {
+        return boundaries_.size();
+    }
+
+    size_t num_groups() const {
+        return group_names_.size();
+    }
+
+private:
+    std::string name_;
+    std::vector<double> boundaries_;
+    std::vector<uint32_t> group_ids_;
+    std::vector<std::string> group_names_;
+
+    // only used while collecting entries
+    std::vector<std::pair<double, uint32_t>> pending_;
+    std::unordered_map<std::string, uint32_t> group_index_;
+};
 
-    nlohmann::json timecode_array = obj["data"];
-    std::string group;
-    for (auto timecode : timecode_array){
+// SAX handler for {"name": ..., "data": [{"t": <ms>, "g": <group>}, ...]}, feeding the entries straight into
+// a group_timeline so the document is never held in memory. "t" may be a number or a numeric string,
+// "g" a string or a number; entries without a usable "t" are skipped and everything else is ignored.
+class group_timeline_sax : public nlohmann::json_sax<nlohmann::json> {
+public:
+    explicit group_timeline_sax(group_timeline& timeline)
+        : timeline_(timeline) {}
+
+    bool null() override {
+        return true;
+    }
+
+    bool boolean(bool) override {
+        return true;
+    }
+
+    bool number_integer(number_integer_t val) override {
+        return scalar(std::to_string(val), true, static_cast<double>(val));
+    }
+
+    bool number_unsigned(number_unsigned_t val) override {
+        return scalar(std::to_string(val), true, static_cast<double>(val));
+    }
+
+    bool number_float(number_float_t val, const string_t& s) override {
+        return scalar(s, true, val);
+    }
+
+    bool string(string_t& val) override {
+        return scalar(val, false, 0.0);
+    }
+
+    bool binary(binary_t&) override {
+        return true;
+    }
 
-        std::string time_str = timecode["t"].dump();
-        time_str.erase(std::remove(time_str.begin(), time_str.end(), '\"'), time_str.end());
-        
-        double time_ms = std::stod(time_str)/1000;
-        if (time_ms > seconds){
-            return group; // return the previous group's
+    bool start_object(std::size_t) override {
+        ++depth_;
+        if (in_data_ && depth_ == 3) {
+            has_time_ = false;
+            group_.clear();
         }
-        group = timecode["g"].dump();
-        group.erase(std::remove(group.begin(), group.end(), '\"'), group.end());
+        return true;
     }
 
-    return group;
-}
\ No newline at end of file
+    bool end_object() override {
+        if (in_data_ && depth_ == 3) {
+            if (has_time_) {
+                timeline_.add(time_, group_);
+            }
+            else {
+                ++num_skipped_;
+            }
+        }
+        --depth_;
+        return true;
+    }
+
+    bool start_array(std::size_t) override {
+        ++depth_;
+        if (depth_ == 2 && key_ == "data") {
+            in_data_ = true;
+        }
+        return true;
+    }
+
+    bool end_array() override {
+        if (depth_ == 2) {
+            in_data_ = false;
+        }
+        --depth_;
+        return true;
+    }
+
+    bool key(string_t& val) override {
+        if (depth_ == 1) {
+            key_ = val;
+        }
+        else if (in_data_ && depth_ == 3) {
+            entry_key_ = val;
+        }
+        return true;
+    }
+
+    bool parse_error(std::size_t position, const std::string&, const nlohmann::detail::exception& ex) override {
+        spdlog::error("Failed to parse group timeline at byte {}: {}", position, ex.what());
+        return false;
+    }
+
+    unsigned int num_skipped() const {
+        return num_skipped_;
+    }
+
+private:
+    bool scalar(const std::string& text, const bool is_number, const double number) {
+        if (depth_ == 1 && key_ == "name") {
+            timeline_.set_name(text);
+        }
+        else if (in_data_ && depth_ == 3) {
+            if (entry_key_ == "t") {
+                if (is_number) {
+                    time_ = number;
+                    has_time_ = true;
+                }
+                else {
+                    char* end = nullptr;
+                    time_ = std::strtod(text.c_str(), &end);
+                    has_time_ = end != text.c_str();
+                }
+            }
+            else if (entry_key_ == "g") {
+                group_ = text;
+            }
+        }
+        return true;
+    }
+
+    group_timeline& timeline_;
+    int depth_ = 0;
+    bool in_data_ = false;
+    std::string key_;
+    std::string entry_key_;
+
+    bool has_time_ = false;
+    double time_ = 0.0;
+    std::string group_;
+    unsigned int num_skipped_ = 0;
+};
+
+// Stream-parse json_dir/json_filename into timeline, returns false if the file is missing or malformed
+inline bool load_group_timeline(const std::string& json_filename, const std::string& json_dir, group_timeline& timeline) {
+    std::ifstream json_file(json_dir + "/" + json_filename, std::ios::binary);
+    if (!json_file.good()) {
+        return false;
+    }
+
+    group_timeline_sax handler(timeline);
+    if (!nlohmann::json::sax_parse(json_file, &handler)) {
+        return false;
+    }
+    if (handler.num_skipped() != 0) {
+        spdlog::warn("Skipped {} entries without a time in {}", handler.num_skipped(), json_filename);
+    }
+    timeline.compile();
+    return true;
+}
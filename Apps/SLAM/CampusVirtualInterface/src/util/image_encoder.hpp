@@ -0,0 +1,127 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <opencv2/core/mat.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <spdlog/spdlog.h>
+
+enum class picture_format_t {
+    PNG,
+    JPEG,
+    WEBP,
+    RAW
+};
+
+inline picture_format_t picture_format_from_string(const std::string& format) {
+    if (format == "png") {
+        return picture_format_t::PNG;
+    }
+    if (format == "jpg" || format == "jpeg") {
+        return picture_format_t::JPEG;
+    }
+    if (format == "webp") {
+        return picture_format_t::WEBP;
+    }
+    if (format == "raw") {
+        return picture_format_t::RAW;
+    }
+    throw std::invalid_argument("Invalid picture format: " + format + " (expected png, jpg, webp or raw)");
+}
+
+// How keyframe snapshots are encoded in --picture-dir
+struct picture_encoding {
+    picture_format_t format = picture_format_t::PNG;
+    int png_compression = 1; // 0-9 - 9 = smallest file, slowest encode
+    int quality = 95;        // 0-100 for JPEG and WebP - 100 = highest quality
+    bool jpeg_progressive = false;
+
+    std::string name() const {
+        switch (format) {
+            case picture_format_t::PNG:
+                return "png";
+            case picture_format_t::JPEG:
+                return "jpg";
+            case picture_format_t::WEBP:
+                return "webp";
+            case picture_format_t::RAW:
+                return "raw";
+        }
+        return "";
+    }
+
+    // Raw frames are written as binary PPM, i.e. the pixel buffer behind a short header with no compression
+    std::string extension() const {
+        return format == picture_format_t::RAW ? ".ppm" : "." + name();
+    }
+
+    std::vector<int> params() const {
+        std::vector<int> params;
+        switch (format) {
+            case picture_format_t::PNG:
+                params.push_back(cv::IMWRITE_PNG_COMPRESSION);
+                params.push_back(png_compression);
+                break;
+            case picture_format_t::JPEG:
+                params.push_back(cv::IMWRITE_JPEG_QUALITY);
+                params.push_back(quality);
+                params.push_back(cv::IMWRITE_JPEG_PROGRESSIVE); // Progressive JPGs used for reduced loading times for frontend
+                params.push_back(jpeg_progressive ? 1 : 0);
+                break;
+            case picture_format_t::WEBP:
+                params.push_back(cv::IMWRITE_WEBP_QUALITY);
+                params.push_back(std::max(1, quality));
+                break;
+            case picture_format_t::RAW:
+                params.push_back(cv::IMWRITE_PXM_BINARY);
+                params.push_back(1);
+                break;
+        }
+        return params;
+    }
+};
+
+// Encodes every frame in memory with each encoding and reports the encode time and output size per frame
+inline void benchmark_picture_encodings(const std::vector<cv::Mat>& frames,
+                                        const std::vector<picture_encoding>& encodings) {
+    if (frames.empty()) {
+        spdlog::warn("Picture benchmark: no frames to encode");
+        return;
+    }
+
+    std::vector<uchar> buffer;
+    for (const auto& encoding : encodings) {
+        double total_encode_time = 0.0;
+        double total_bytes = 0.0;
+        bool is_available = true;
+        for (const auto& frame : frames) {
+            const auto tp_1 = std::chrono::steady_clock::now();
+            try {
+                is_available = cv::imencode(encoding.extension(), frame, buffer, encoding.params());
+            }
+            catch (const cv::Exception& e) {
+                is_available = false;
+            }
+            if (!is_available) {
+                break;
+            }
+            const auto tp_2 = std::chrono::steady_clock::now();
+            total_encode_time += std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(tp_2 - tp_1).count();
+            total_bytes += static_cast<double>(buffer.size());
+        }
+        if (!is_available) {
+            spdlog::error("Picture benchmark: {} encoder is not available", encoding.name());
+            continue;
+        }
+        std::cout << "Picture format: " << encoding.name()
+                  << " - png compression: " << encoding.png_compression
+                  << " - quality: " << encoding.quality
+                  << " - encode: " << total_encode_time / frames.size() << "[ms/frame]"
+                  << " - size: " << total_bytes / frames.size() << "[bytes/frame]" << std::endl;
+    }
+}
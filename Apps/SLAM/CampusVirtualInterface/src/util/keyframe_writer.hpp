@@ -0,0 +1,133 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <opencv2/core/mat.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <spdlog/spdlog.h>
+
+#include "bounded_queue.hpp"
+#include "frame_buffer_pool.hpp"
+
+// A keyframe snapshot waiting for the image writers
+struct keyframe_write_job {
+    std::string filepath;
+    pooled_frame_buffer buffer;
+    std::vector<int> params;
+    std::chrono::steady_clock::time_point enqueued_at;
+};
+
+// Saves keyframe snapshots on a pool of threads so encoding never blocks the tracker.
+// Frame buffers are moved into a bounded queue and go back to their pool once written; when the queue is full
+// enqueue() blocks, which bounds the memory held by pending full resolution frames.
+// shutdown() (also run by the destructor) writes everything still queued.
+class keyframe_writer {
+public:
+    struct write_stats {
+        unsigned long num_written = 0;
+        unsigned long num_failed = 0;
+        size_t max_queue_size = 0;
+        std::vector<double> write_times; // imwrite duration of every snapshot [s]
+        std::vector<double> wait_times;  // time every snapshot spent queued [s]
+    };
+
+    keyframe_writer(const unsigned int num_threads, const unsigned int queue_depth)
+        : queue_(queue_depth) {
+        for (unsigned int i = 0; i < std::max(1u, num_threads); ++i) {
+            threads_.emplace_back([this]() { run(); });
+        }
+    }
+
+    ~keyframe_writer() {
+        shutdown();
+    }
+
+    keyframe_writer(const keyframe_writer&) = delete;
+    keyframe_writer& operator=(const keyframe_writer&) = delete;
+
+    bool enqueue(const std::string& filepath, pooled_frame_buffer&& buffer, const std::vector<int>& params) {
+        keyframe_write_job job{filepath, std::move(buffer), params, std::chrono::steady_clock::now()};
+        if (!queue_.push(std::move(job))) {
+            spdlog::warn("Keyframe writer is shut down, dropping {}", filepath);
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(mtx_stats_);
+        stats_.max_queue_size = std::max(stats_.max_queue_size, queue_.size());
+        return true;
+    }
+
+    // Blocks until every queued snapshot is written
+    void shutdown() {
+        queue_.close();
+        for (auto& thread : threads_) {
+            if (thread.joinable()) {
+                thread.join();
+            }
+        }
+    }
+
+    write_stats get_stats() const {
+        std::lock_guard<std::mutex> lock(mtx_stats_);
+        return stats_;
+    }
+
+    void log_stats() const {
+        auto stats = get_stats();
+        if (stats.write_times.empty()) {
+            spdlog::info("Keyframe writer: no snapshots written");
+            return;
+        }
+        std::sort(stats.write_times.begin(), stats.write_times.end());
+        std::sort(stats.wait_times.begin(), stats.wait_times.end());
+        const auto total_write_time = std::accumulate(stats.write_times.begin(), stats.write_times.end(), 0.0);
+        spdlog::info("Keyframe writer: {} written, {} failed, max queue size {}",
+                     stats.num_written, stats.num_failed, stats.max_queue_size);
+        spdlog::info("Keyframe writer: median write time {:.4f}[s], mean write time {:.4f}[s], max write time {:.4f}[s]",
+                     stats.write_times.at(stats.write_times.size() / 2),
+                     total_write_time / stats.write_times.size(),
+                     stats.write_times.back());
+        spdlog::info("Keyframe writer: median queue wait {:.4f}[s], max queue wait {:.4f}[s]",
+                     stats.wait_times.at(stats.wait_times.size() / 2),
+                     stats.wait_times.back());
+    }
+
+private:
+    void run() {
+        keyframe_write_job job;
+        while (queue_.pop(job)) {
+            const auto tp_1 = std::chrono::steady_clock::now();
+            bool ok = false;
+            try {
+                ok = cv::imwrite(job.filepath, job.buffer->frame, job.params);
+            }
+            catch (const cv::Exception& e) {
+                spdlog::error("Failed to write {}: {}", job.filepath, e.what());
+            }
+            const auto tp_2 = std::chrono::steady_clock::now();
+            job.buffer.reset();
+
+            std::lock_guard<std::mutex> lock(mtx_stats_);
+            if (ok) {
+                ++stats_.num_written;
+            }
+            else {
+                ++stats_.num_failed;
+            }
+            stats_.write_times.push_back(std::chrono::duration_cast<std::chrono::duration<double>>(tp_2 - tp_1).count());
+            stats_.wait_times.push_back(std::chrono::duration_cast<std::chrono::duration<double>>(tp_1 - job.enqueued_at).count());
+        }
+    }
+
+    bounded_queue<keyframe_write_job> queue_;
+    std::vector<std::thread> threads_;
+
+    mutable std::mutex mtx_stats_;
+    write_stats stats_;
+};
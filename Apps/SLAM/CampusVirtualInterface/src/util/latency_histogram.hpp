@@ -0,0 +1,170 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <string>
+
+#include <nlohmann/json.hpp>
+#include <spdlog/spdlog.h>
+
+// Fixed bucket latency histogram with microsecond resolution, laid out like an HDR histogram:
+// values below 32us get a bucket each, above that every power of two is split into 32 linear sub-buckets,
+// so a reported percentile is never more than ~3% above the recorded value. Recording is a couple of relaxed
+// atomic adds, so pipeline stages running on several threads can share one histogram without a lock.
+class latency_histogram {
+public:
+    static constexpr int sub_bucket_bits = 5;
+    static constexpr uint64_t sub_bucket_count = 1u << sub_bucket_bits;
+    // the largest bucket starts at 2^40 us (~12 days), anything beyond is clamped into it
+    static constexpr int max_exponent = 40;
+    static constexpr size_t num_buckets = (max_exponent - sub_bucket_bits + 2) * sub_bucket_count;
+
+    void record(const std::chrono::steady_clock::duration& duration) {
+        const auto us = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+        record_us(us < 0 ? 0 : static_cast<uint64_t>(us));
+    }
+
+    void record_seconds(const double seconds) {
+        record_us(seconds <= 0.0 ? 0 : static_cast<uint64_t>(std::llround(seconds * 1e6)));
+    }
+
+    void record_us(const uint64_t us) {
+        buckets_[bucket_index(us)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_us_.fetch_add(us, std::memory_order_relaxed);
+        uint64_t max = max_us_.load(std::memory_order_relaxed);
+        while (max < us && !max_us_.compare_exchange_weak(max, us, std::memory_order_relaxed)) {}
+        uint64_t min = min_us_.load(std::memory_order_relaxed);
+        while (us < min && !min_us_.compare_exchange_weak(min, us, std::memory_order_relaxed)) {}
+    }
+
+    uint64_t count() const {
+        return count_.load(std::memory_order_relaxed);
+    }
+
+    // Highest value equivalent to the p-th percentile [s], 0 when nothing was recorded
+    double percentile(const double p) const {
+        const uint64_t total = count();
+        if (total == 0) {
+            return 0.0;
+        }
+        const auto rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(p / 100.0 * total)));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < num_buckets; ++i) {
+            seen += buckets_[i].load(std::memory_order_relaxed);
+            if (rank <= seen) {
+                return std::min(bucket_high_us(i), max_us_.load(std::memory_order_relaxed)) * 1e-6;
+            }
+        }
+        return max_us_.load(std::memory_order_relaxed) * 1e-6;
+    }
+
+    double mean() const {
+        const uint64_t total = count();
+        return total == 0 ? 0.0 : sum_us_.load(std::memory_order_relaxed) * 1e-6 / total;
+    }
+
+    double min() const {
+        return count() == 0 ? 0.0 : min_us_.load(std::memory_order_relaxed) * 1e-6;
+    }
+
+    double max() const {
+        return max_us_.load(std::memory_order_relaxed) * 1e-6;
+    }
+
+    // Summary in seconds plus the non-empty buckets as [low_us, high_us, count], so runs can be merged later
+    nlohmann::json to_json() const {
+        nlohmann::json buckets = nlohmann::json::array();
+        for (size_t i = 0; i < num_buckets; ++i) {
+            const auto bucket_count = buckets_[i].load(std::memory_order_relaxed);
+            if (bucket_count != 0) {
+                buckets.push_back({bucket_low_us(i), bucket_high_us(i), bucket_count});
+            }
+        }
+        return {
+            {"count", count()},
+            {"mean", mean()},
+            {"min", min()},
+            {"p50", percentile(50)},
+            {"p90", percentile(90)},
+            {"p99", percentile(99)},
+            {"max", max()},
+            {"buckets", buckets}};
+    }
+
+    static size_t bucket_index(const uint64_t us) {
+        if (us < sub_bucket_count) {
+            return static_cast<size_t>(us);
+        }
+        const int exponent = std::min(63 - __builtin_clzll(us), max_exponent);
+        const int shift = exponent - sub_bucket_bits;
+        const uint64_t sub_bucket = std::min(us >> shift, 2 * sub_bucket_count - 1) - sub_bucket_count;
+        return static_cast<size_t>(shift + 1) * sub_bucket_count + sub_bucket;
+    }
+
+    static uint64_t bucket_low_us(const size_t index) {
+        if (index < sub_bucket_count) {
+            return index;
+        }
+        const auto shift = index / sub_bucket_count - 1;
+        return (sub_bucket_count + index % sub_bucket_count) << shift;
+    }
+
+    static uint64_t bucket_high_us(const size_t index) {
+        if (index < sub_bucket_count) {
+            return index;
+        }
+        const auto shift = index / sub_bucket_count - 1;
+        return bucket_low_us(index) + (uint64_t(1) << shift) - 1;
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, num_buckets> buckets_{};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_us_{0};
+    std::atomic<uint64_t> min_us_{UINT64_MAX};
+    std::atomic<uint64_t> max_us_{0};
+};
+
+// Latency of every stage a frame passes through in mono_tracking
+struct stage_latencies {
+    latency_histogram decode;      // video read (and grayscale conversion) of one frame
+    latency_histogram resize;      // downscale to the SLAM resolution
+    latency_histogram track;       // feed_monocular_frame_bool
+    latency_histogram keyframe;    // snapshot hand-off to the image writers for keyframes, incl. waiting on a full queue
+    latency_histogram encode;      // imwrite of one snapshot on a writer thread
+    latency_histogram json_lookup; // group_timeline lookup for keyframes
+
+    nlohmann::json to_json() const {
+        return {
+            {"decode", decode.to_json()},
+            {"resize", resize.to_json()},
+            {"track", track.to_json()},
+            {"keyframe", keyframe.to_json()},
+            {"encode", encode.to_json()},
+            {"json_lookup", json_lookup.to_json()}};
+    }
+
+    void log() const {
+        log_stage("decode", decode);
+        log_stage("resize", resize);
+        log_stage("track", track);
+        log_stage("keyframe", keyframe);
+        log_stage("encode", encode);
+        log_stage("json_lookup", json_lookup);
+    }
+
+private:
+    static void log_stage(const std::string& name, const latency_histogram& histogram) {
+        if (histogram.count() == 0) {
+            return;
+        }
+        spdlog::info("Stage {}: {} samples, p50 {:.4f}[s], p90 {:.4f}[s], p99 {:.4f}[s], max {:.4f}[s]",
+                     name, histogram.count(), histogram.percentile(50), histogram.percentile(90),
+                     histogram.percentile(99), histogram.max());
+    }
+};
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <sqlite3.h>
+#include <spdlog/spdlog.h>
+
+// A keyframe as stored in a stella_vslam map database
+struct map_keyframe {
+    unsigned int id = 0;
+    double timestamp = 0.0;
+    std::array<double, 16> pose_cw{}; // 4x4 camera pose, row-major
+    std::array<double, 3> trans_wc{}; // camera centre in world coordinates
+    long span_parent = -1;            // -1 for the root of the spanning tree
+    std::vector<unsigned int> spanning_children;
+    std::vector<unsigned int> loop_edges;
+};
+
+// Read-only reader for the keyframes, poses and graph edges of a stella_vslam SQLite map database.
+// Rows are decoded one at a time straight from the file, so unlike loading the map into a stella_vslam::system
+// it needs no vocabulary, no threads and no memory for landmarks or descriptors.
+class map_db_reader {
+public:
+    explicit map_db_reader(const std::string& path)
+        : path_(path) {
+        if (sqlite3_open_v2(path.c_str(), &db_, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK) {
+            spdlog::error("Failed to open map database {}: {}", path, db_ ? sqlite3_errmsg(db_) : "out of memory");
+            sqlite3_close(db_);
+            db_ = nullptr;
+        }
+    }
+
+    ~map_db_reader() {
+        sqlite3_close(db_);
+    }
+
+    map_db_reader(const map_db_reader&) = delete;
+    map_db_reader& operator=(const map_db_reader&) = delete;
+
+    bool is_open() const {
+        return db_ != nullptr;
+    }
+
+    // Decode every keyframe in id order and pass it to callback, returns false if the map could not be read
+    bool for_each_keyframe(const std::function<void(const map_keyframe&)>& callback) const {
+        if (!db_) {
+            return false;
+        }
+
+        // stella_vslam keeps the graph in an associations table, older maps keep it in the keyframes table
+        const std::string sql = has_table("associations")
+                                    ? "SELECT k.id, k.ts, k.pose_cw, a.span_parent, a.n_spanning_children, a.spanning_children, "
+                                      "a.n_loop_edges, a.loop_edges FROM keyframes k LEFT JOIN associations a ON a.id = k.id ORDER BY k.id"
+                                    : "SELECT id, ts, pose_cw, span_parent, n_spanning_children, spanning_children, "
+                                      "n_loop_edges, loop_edges FROM keyframes ORDER BY id";
+        sqlite3_stmt* stmt = nullptr;
+        if (sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+            spdlog::error("Failed to read keyframes from {}: {}", path_, sqlite3_errmsg(db_));
+            return false;
+        }
+
+        map_keyframe keyfrm;
+        int ret;
+        while ((ret = sqlite3_step(stmt)) == SQLITE_ROW) {
+            keyfrm.id = static_cast<unsigned int>(sqlite3_column_int64(stmt, 0));
+            keyfrm.timestamp = sqlite3_column_double(stmt, 1);
+            if (!decode_pose(sqlite3_column_blob(stmt, 2), sqlite3_column_bytes(stmt, 2), keyfrm)) {
+                spdlog::warn("Skipping keyframe {} of {}: unexpected pose size", keyfrm.id, path_);
+                continue;
+            }
+            keyfrm.span_parent = sqlite3_column_type(stmt, 3) == SQLITE_NULL ? -1 : sqlite3_column_int64(stmt, 3);
+            decode_ids(sqlite3_column_blob(stmt, 5), sqlite3_column_bytes(stmt, 5), sqlite3_column_int64(stmt, 4), keyfrm.spanning_children);
+            decode_ids(sqlite3_column_blob(stmt, 7), sqlite3_column_bytes(stmt, 7), sqlite3_column_int64(stmt, 6), keyfrm.loop_edges);
+            callback(keyfrm);
+        }
+        sqlite3_finalize(stmt);
+
+        if (ret != SQLITE_DONE) {
+            spdlog::error("Failed to read keyframes from {}: {}", path_, sqlite3_errmsg(db_));
+            return false;
+        }
+        return true;
+    }
+
+private:
+    bool has_table(const std::string& name) const {
+        sqlite3_stmt* stmt = nullptr;
+        if (sqlite3_prepare_v2(db_, "SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = ?", -1, &stmt, nullptr) != SQLITE_OK) {
+            return false;
+        }
+        sqlite3_bind_text(stmt, 1, name.c_str(), -1, SQLITE_TRANSIENT);
+        const bool found = sqlite3_step(stmt) == SQLITE_ROW;
+        sqlite3_finalize(stmt);
+        return found;
+    }
+
+    // pose_cw is the raw column-major data of an Eigen 4x4 double matrix
+    static bool decode_pose(const void* blob, const int num_bytes, map_keyframe& keyfrm) {
+        if (!blob || num_bytes != static_cast<int>(16 * sizeof(double))) {
+            return false;
+        }
+        double col_major[16];
+        std::memcpy(col_major, blob, sizeof(col_major));
+        for (int row = 0; row < 4; ++row) {
+            for (int col = 0; col < 4; ++col) {
+                keyfrm.pose_cw[row * 4 + col] = col_major[col * 4 + row];
+            }
+        }
+        // t_wc = -R_cw^T * t_cw
+        for (int i = 0; i < 3; ++i) {
+            keyfrm.trans_wc[i] = -(keyfrm.pose_cw[0 * 4 + i] * keyfrm.pose_cw[0 * 4 + 3]
+                                   + keyfrm.pose_cw[1 * 4 + i] * keyfrm.pose_cw[1 * 4 + 3]
+                                   + keyfrm.pose_cw[2 * 4 + i] * keyfrm.pose_cw[2 * 4 + 3]);
+        }
+        return true;
+    }
+
+    // Keyframe id lists are raw integer arrays, the element width is taken from the blob size and the stored count
+    static void decode_ids(const void* blob, const int num_bytes, const int64_t count, std::vector<unsigned int>& ids) {
+        ids.clear();
+        if (!blob || count <= 0 || num_bytes <= 0 || num_bytes % count != 0) {
+            return;
+        }
+        const auto elem_size = num_bytes / count;
+        const auto* bytes = static_cast<const unsigned char*>(blob);
+        for (int64_t i = 0; i < count; ++i) {
+            if (elem_size == sizeof(int32_t)) {
+                int32_t id;
+                std::memcpy(&id, bytes + i * elem_size, sizeof(id));
+                ids.push_back(static_cast<unsigned int>(id));
+            }
+            else if (elem_size == sizeof(int64_t)) {
+                int64_t id;
+                std::memcpy(&id, bytes + i * elem_size, sizeof(id));
+                ids.push_back(static_cast<unsigned int>(id));
+            }
+        }
+    }
+
+    std::string path_;
+    sqlite3* db_ = nullptr;
+};
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <spdlog/spdlog.h>
+
+// Read-only shared mapping of a whole file, for the navigation files that are used in place and the vocabulary
+// readahead. MADV_WILLNEED starts reading the file in the background as soon as it is mapped.
+class mapped_file {
+public:
+    explicit mapped_file(const std::string& path) {
+        fd_ = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd_ < 0) {
+            spdlog::error("Unable to open {}", path);
+            return;
+        }
+        struct stat st {};
+        if (fstat(fd_, &st) != 0 || st.st_size == 0) {
+            spdlog::error("Unable to map the empty file {}", path);
+            return;
+        }
+        size_ = static_cast<size_t>(st.st_size);
+        void* data = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd_, 0);
+        if (data == MAP_FAILED) {
+            spdlog::error("Unable to map {}", path);
+            size_ = 0;
+            return;
+        }
+        data_ = static_cast<const char*>(data);
+        madvise(const_cast<char*>(data_), size_, MADV_WILLNEED);
+    }
+
+    ~mapped_file() {
+        if (data_) {
+            munmap(const_cast<char*>(data_), size_);
+        }
+        if (0 <= fd_) {
+            close(fd_);
+        }
+    }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    bool is_mapped() const {
+        return data_ != nullptr;
+    }
+
+    const char* data() const {
+        return data_;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    // Typed view of count elements at offset, false if they are misaligned or not inside the file
+    template<typename T>
+    bool section(const uint64_t offset, const uint64_t count, const T*& ptr) const {
+        if (offset % alignof(T) != 0 || size_ < offset || (size_ - offset) / sizeof(T) < count) {
+            return false;
+        }
+        ptr = reinterpret_cast<const T*>(data_ + offset);
+        return true;
+    }
+
+    // Fault every page in, returns the number of pages touched
+    size_t touch() const {
+        if (!data_) {
+            return 0;
+        }
+        const auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        volatile char sink = 0;
+        size_t num_pages = 0;
+        for (size_t offset = 0; offset < size_; offset += page_size, ++num_pages) {
+            sink = sink + data_[offset];
+        }
+        return num_pages;
+    }
+
+private:
+    int fd_ = -1;
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+};
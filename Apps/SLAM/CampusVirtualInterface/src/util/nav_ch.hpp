@@ -0,0 +1,574 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "nav_graph.hpp"
+#include "nav_path.hpp"
+
+// Contraction hierarchy over a navigation graph, with edges weighted by the world-frame distance between keyframes.
+// Nodes are contracted one by one, least important first, and a shortcut replaces every shortest path that ran
+// through the contracted node. A query then only relaxes edges towards more important nodes, from both ends,
+// and settles a few hundred nodes however far apart the ends are. Shortcuts remember the node they bypass,
+// so routes unpack back into keyframes of the navigation graph.
+//
+//   header
+//   ranks        uint32[num_nodes]      contraction order of every node of the navigation graph
+//   up_offsets   uint32[num_nodes + 1]  upward edges of node i are [up_offsets[i], up_offsets[i + 1])
+//   up_targets   uint32[num_up_edges]   the more important end of the edge
+//   up_weights   double[num_up_edges]
+//   up_middles   uint32[num_up_edges]   node the shortcut bypasses, nav_graph::npos for an edge of the graph
+struct nav_ch_header {
+    char magic[4];
+    uint32_t version;
+    uint32_t num_nodes;
+    uint32_t num_up_edges;
+    uint32_t graph_num_edges; // of the navigation graph the hierarchy was built from
+    uint32_t reserved;
+    uint64_t ranks_offset;
+    uint64_t up_offsets_offset;
+    uint64_t up_targets_offset;
+    uint64_t up_weights_offset;
+    uint64_t up_middles_offset;
+    uint64_t file_size;
+};
+
+constexpr char nav_ch_magic[4] = {'C', 'V', 'C', 'H'};
+constexpr uint32_t nav_ch_version = 1;
+
+class nav_ch_builder {
+public:
+    struct build_stats {
+        uint32_t num_shortcuts = 0;
+        uint32_t num_up_edges = 0;
+    };
+
+    // witness_limit bounds the nodes a witness search settles, a lower limit builds faster but adds more shortcuts
+    explicit nav_ch_builder(const nav_graph& graph, const uint32_t witness_limit = 500)
+        : graph_(graph), witness_limit_(witness_limit) {}
+
+    bool build(const std::string& path, build_stats& stats) {
+        const auto n = graph_.num_nodes();
+        adjacency_.assign(n, {});
+        for (uint32_t node = 0; node < n; ++node) {
+            for (const auto neighbour : graph_.neighbours(node)) {
+                if (neighbour != node) {
+                    add_or_improve(node, neighbour, graph_.distance(node, neighbour), nav_graph::npos);
+                }
+            }
+        }
+        contracted_.assign(n, false);
+        num_contracted_neighbours_.assign(n, 0);
+        depth_.assign(n, 0);
+        witness_dist_.assign(n, 0.0);
+        witness_seen_.assign(n, 0);
+        witness_target_.assign(n, 0);
+        witness_generation_ = 0;
+
+        std::vector<uint32_t> ranks(n);
+        std::vector<std::vector<edge>> up_edges(n);
+
+        // contract by priority, which is re-evaluated when a node comes up and after a neighbour was contracted
+        using entry = std::pair<int, uint32_t>;
+        std::priority_queue<entry, std::vector<entry>, std::greater<entry>> queue;
+        std::vector<int> priorities(n);
+        for (uint32_t node = 0; node < n; ++node) {
+            priorities[node] = priority(node);
+            queue.emplace(priorities[node], node);
+        }
+        uint32_t rank = 0;
+        std::vector<edge> shortcuts;
+        while (!queue.empty()) {
+            const auto top = queue.top();
+            const auto node = top.second;
+            queue.pop();
+            if (contracted_[node] || top.first != priorities[node]) {
+                continue; // superseded by a later entry with the updated priority
+            }
+            priorities[node] = priority(node);
+            if (!queue.empty() && queue.top().first < priorities[node]) {
+                queue.emplace(priorities[node], node);
+                continue;
+            }
+
+            find_shortcuts(node, shortcuts, witness_limit_);
+            for (const auto& shortcut : shortcuts) {
+                // an edge between the two may already exist, it is replaced only by a shorter shortcut
+                if (add_or_improve(shortcut.target, shortcut.middle_source, shortcut.weight, node)) {
+                    add_or_improve(shortcut.middle_source, shortcut.target, shortcut.weight, node);
+                    ++stats.num_shortcuts;
+                }
+            }
+
+            ranks[node] = rank++;
+            contracted_[node] = true;
+            for (const auto& e : adjacency_[node]) {
+                up_edges[node].push_back(e);
+                ++num_contracted_neighbours_[e.target];
+                depth_[e.target] = std::max(depth_[e.target], depth_[node] + 1);
+                remove_edge(e.target, node);
+            }
+            for (const auto& e : adjacency_[node]) {
+                const int updated = priority(e.target);
+                if (updated != priorities[e.target]) {
+                    priorities[e.target] = updated;
+                    queue.emplace(updated, e.target);
+                }
+            }
+            std::vector<edge>().swap(adjacency_[node]);
+        }
+
+        return write(path, ranks, up_edges, stats);
+    }
+
+private:
+    struct edge {
+        uint32_t target;
+        double weight;
+        uint32_t middle; // node the shortcut bypasses, npos for an edge of the graph
+        uint32_t middle_source = nav_graph::npos; // only used for candidate shortcuts, the other end
+    };
+
+    // Shortcuts needed between the remaining neighbours of node if it were contracted now
+    void find_shortcuts(const uint32_t node, std::vector<edge>& shortcuts, const uint32_t settle_limit) {
+        shortcuts.clear();
+        const auto& neighbours = adjacency_[node];
+        for (size_t i = 0; i + 1 < neighbours.size(); ++i) {
+            double max_weight = 0.0;
+            for (size_t j = i + 1; j < neighbours.size(); ++j) {
+                max_weight = std::max(max_weight, neighbours[i].weight + neighbours[j].weight);
+            }
+            witness_search(node, i, max_weight, settle_limit);
+            for (size_t j = i + 1; j < neighbours.size(); ++j) {
+                const double weight = neighbours[i].weight + neighbours[j].weight;
+                const auto target = neighbours[j].target;
+                if (witness_seen_[target] != witness_generation_ || weight < witness_dist_[target]) {
+                    shortcuts.push_back({target, weight, node, neighbours[i].target});
+                }
+            }
+        }
+    }
+
+    // Shortcuts added minus edges removed, plus the neighbours already contracted and the depth of the hierarchy
+    // below the node to spread contraction evenly. The shortcuts are only estimated, by witness searches that
+    // settle a handful of nodes, which builds several times faster for the same query times.
+    int priority(const uint32_t node) {
+        find_shortcuts(node, candidates_, priority_witness_limit);
+        return static_cast<int>(candidates_.size()) - static_cast<int>(adjacency_[node].size())
+               + static_cast<int>(num_contracted_neighbours_[node]) + static_cast<int>(depth_[node]);
+    }
+
+    // Bounded Dijkstra among the uncontracted nodes from the source-th neighbour of node, without passing through node.
+    // It stops once the neighbours after the source are settled or nothing closer than max_weight is left.
+    void witness_search(const uint32_t node, const size_t source, const double max_weight, const uint32_t settle_limit) {
+        if (++witness_generation_ == 0) {
+            std::fill(witness_seen_.begin(), witness_seen_.end(), 0);
+            std::fill(witness_target_.begin(), witness_target_.end(), 0);
+            witness_generation_ = 1;
+        }
+        const auto& neighbours = adjacency_[node];
+        for (size_t j = source + 1; j < neighbours.size(); ++j) {
+            witness_target_[neighbours[j].target] = witness_generation_;
+        }
+        size_t num_targets_left = neighbours.size() - source - 1;
+
+        const auto greater = std::greater<std::pair<double, uint32_t>>();
+        witness_heap_.clear();
+        witness_seen_[neighbours[source].target] = witness_generation_;
+        witness_dist_[neighbours[source].target] = 0.0;
+        witness_heap_.emplace_back(0.0, neighbours[source].target);
+        uint32_t num_settled = 0;
+        while (!witness_heap_.empty() && num_settled < settle_limit) {
+            std::pop_heap(witness_heap_.begin(), witness_heap_.end(), greater);
+            const auto top = witness_heap_.back();
+            witness_heap_.pop_back();
+            if (witness_dist_[top.second] < top.first) {
+                continue;
+            }
+            ++num_settled;
+            if (witness_target_[top.second] == witness_generation_ && --num_targets_left == 0) {
+                break;
+            }
+            for (const auto& e : adjacency_[top.second]) {
+                const double dist = top.first + e.weight;
+                if (e.target == node || max_weight < dist) {
+                    continue;
+                }
+                if (witness_seen_[e.target] != witness_generation_ || dist < witness_dist_[e.target]) {
+                    witness_seen_[e.target] = witness_generation_;
+                    witness_dist_[e.target] = dist;
+                    witness_heap_.emplace_back(dist, e.target);
+                    std::push_heap(witness_heap_.begin(), witness_heap_.end(), greater);
+                }
+            }
+        }
+    }
+
+    // Returns false if an edge at least as short already connects the two nodes
+    bool add_or_improve(const uint32_t from, const uint32_t to, const double weight, const uint32_t middle) {
+        for (auto& e : adjacency_[from]) {
+            if (e.target == to) {
+                if (e.weight <= weight) {
+                    return false;
+                }
+                e.weight = weight;
+                e.middle = middle;
+                return true;
+            }
+        }
+        adjacency_[from].push_back({to, weight, middle});
+        return true;
+    }
+
+    void remove_edge(const uint32_t from, const uint32_t to) {
+        auto& edges = adjacency_[from];
+        edges.erase(std::remove_if(edges.begin(), edges.end(), [to](const edge& e) {
+                        return e.target == to;
+                    }),
+                    edges.end());
+    }
+
+    bool write(const std::string& path, const std::vector<uint32_t>& ranks,
+               const std::vector<std::vector<edge>>& up_edges, build_stats& stats) const {
+        const auto n = graph_.num_nodes();
+        std::vector<uint32_t> up_offsets(n + 1, 0), up_targets, up_middles;
+        std::vector<double> up_weights;
+        for (uint32_t node = 0; node < n; ++node) {
+            for (const auto& e : up_edges[node]) {
+                up_targets.push_back(e.target);
+                up_weights.push_back(e.weight);
+                up_middles.push_back(e.middle);
+            }
+            up_offsets[node + 1] = static_cast<uint32_t>(up_targets.size());
+        }
+        stats.num_up_edges = static_cast<uint32_t>(up_targets.size());
+
+        nav_ch_header header{};
+        std::memcpy(header.magic, nav_ch_magic, sizeof(header.magic));
+        header.version = nav_ch_version;
+        header.num_nodes = n;
+        header.num_up_edges = stats.num_up_edges;
+        header.graph_num_edges = graph_.num_edges();
+        uint64_t offset = sizeof(header);
+        const auto place = [&offset](const size_t num_bytes) {
+            offset = (offset + 63) & ~uint64_t(63);
+            const auto section = offset;
+            offset += num_bytes;
+            return section;
+        };
+        header.ranks_offset = place(ranks.size() * sizeof(uint32_t));
+        header.up_offsets_offset = place(up_offsets.size() * sizeof(uint32_t));
+        header.up_targets_offset = place(up_targets.size() * sizeof(uint32_t));
+        header.up_weights_offset = place(up_weights.size() * sizeof(double));
+        header.up_middles_offset = place(up_middles.size() * sizeof(uint32_t));
+        header.file_size = offset;
+
+        std::ofstream ofs(path, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!ofs.is_open()) {
+            spdlog::error("Unable to write the contraction hierarchy {}", path);
+            return false;
+        }
+        uint64_t written = 0;
+        const auto write_section = [&ofs, &written](const uint64_t section, const void* data, const size_t num_bytes) {
+            static const char padding[64] = {};
+            ofs.write(padding, static_cast<std::streamsize>(section - written));
+            ofs.write(static_cast<const char*>(data), static_cast<std::streamsize>(num_bytes));
+            written = section + num_bytes;
+        };
+        write_section(0, &header, sizeof(header));
+        write_section(header.ranks_offset, ranks.data(), ranks.size() * sizeof(uint32_t));
+        write_section(header.up_offsets_offset, up_offsets.data(), up_offsets.size() * sizeof(uint32_t));
+        write_section(header.up_targets_offset, up_targets.data(), up_targets.size() * sizeof(uint32_t));
+        write_section(header.up_weights_offset, up_weights.data(), up_weights.size() * sizeof(double));
+        write_section(header.up_middles_offset, up_middles.data(), up_middles.size() * sizeof(uint32_t));
+        ofs.close();
+        if (!ofs) {
+            spdlog::error("Unable to write the contraction hierarchy {}", path);
+            return false;
+        }
+        return true;
+    }
+
+    static constexpr uint32_t priority_witness_limit = 10;
+
+    const nav_graph& graph_;
+    const uint32_t witness_limit_;
+
+    std::vector<std::vector<edge>> adjacency_; // edges between uncontracted nodes, in both directions
+    std::vector<bool> contracted_;
+    std::vector<uint32_t> num_contracted_neighbours_;
+    std::vector<uint32_t> depth_;
+
+    std::vector<double> witness_dist_;
+    std::vector<uint32_t> witness_seen_;
+    std::vector<uint32_t> witness_target_;
+    uint32_t witness_generation_ = 0;
+    std::vector<std::pair<double, uint32_t>> witness_heap_;
+    std::vector<edge> candidates_;
+};
+
+// Read-only view of a contraction hierarchy file, used in place like nav_graph
+class nav_ch {
+public:
+    nav_ch(const std::string& path, const nav_graph& graph)
+        : path_(path), file_(path) {
+        is_open_ = file_.is_mapped() && validate(graph);
+    }
+
+    nav_ch(const nav_ch&) = delete;
+    nav_ch& operator=(const nav_ch&) = delete;
+
+    bool is_open() const {
+        return is_open_;
+    }
+
+    uint32_t num_nodes() const {
+        return header_.num_nodes;
+    }
+
+    uint32_t num_up_edges() const {
+        return header_.num_up_edges;
+    }
+
+    uint32_t rank(const uint32_t node) const {
+        return ranks_[node];
+    }
+
+    uint32_t up_begin(const uint32_t node) const {
+        return up_offsets_[node];
+    }
+
+    uint32_t up_end(const uint32_t node) const {
+        return up_offsets_[node + 1];
+    }
+
+    uint32_t target(const uint32_t edge) const {
+        return up_targets_[edge];
+    }
+
+    double weight(const uint32_t edge) const {
+        return up_weights_[edge];
+    }
+
+    uint32_t middle(const uint32_t edge) const {
+        return up_middles_[edge];
+    }
+
+    // Upward edge between two nodes, from the less important one, npos if there is none
+    uint32_t find_edge(const uint32_t node0, const uint32_t node1) const {
+        const bool node0_lower = ranks_[node0] < ranks_[node1];
+        const auto from = node0_lower ? node0 : node1;
+        const auto to = node0_lower ? node1 : node0;
+        for (auto e = up_offsets_[from]; e < up_offsets_[from + 1]; ++e) {
+            if (up_targets_[e] == to) {
+                return e;
+            }
+        }
+        return nav_graph::npos;
+    }
+
+private:
+    // Checks the header against the graph and every index, so queries need no bounds checks afterwards.
+    // Every failure resets the header, so an unopened file reads as empty rather than as the counts it claims
+    bool validate(const nav_graph& graph) {
+        if (file_.size() < sizeof(header_)) {
+            spdlog::error("{} is not a contraction hierarchy", path_);
+            header_ = {};
+            return false;
+        }
+        std::memcpy(&header_, file_.data(), sizeof(header_));
+        if (std::memcmp(header_.magic, nav_ch_magic, sizeof(header_.magic)) != 0 || header_.version != nav_ch_version) {
+            spdlog::error("{} is not a contraction hierarchy of version {}", path_, nav_ch_version);
+            header_ = {};
+            return false;
+        }
+        if (header_.num_nodes != graph.num_nodes() || header_.graph_num_edges != graph.num_edges()) {
+            spdlog::error("{} was built from a different navigation graph", path_);
+            header_ = {};
+            return false;
+        }
+        const uint64_t n = header_.num_nodes;
+        const uint64_t m = header_.num_up_edges;
+        const bool sections_ok = header_.file_size == file_.size()
+                                 && file_.section(header_.ranks_offset, n, ranks_)
+                                 && file_.section(header_.up_offsets_offset, n + 1, up_offsets_)
+                                 && file_.section(header_.up_targets_offset, m, up_targets_)
+                                 && file_.section(header_.up_weights_offset, m, up_weights_)
+                                 && file_.section(header_.up_middles_offset, m, up_middles_);
+        if (!sections_ok) {
+            spdlog::error("{} is truncated or corrupt", path_);
+            header_ = {};
+            return false;
+        }
+        bool indices_ok = up_offsets_[0] == 0 && up_offsets_[n] == m;
+        for (uint64_t i = 0; indices_ok && i < n; ++i) {
+            indices_ok = up_offsets_[i] <= up_offsets_[i + 1] && ranks_[i] < n;
+        }
+        for (uint64_t e = 0; indices_ok && e < m; ++e) {
+            indices_ok = up_targets_[e] < n && (up_middles_[e] == nav_graph::npos || up_middles_[e] < n);
+        }
+        if (!indices_ok) {
+            spdlog::error("{} has out of range indices", path_);
+            header_ = {};
+            return false;
+        }
+        return true;
+    }
+
+    std::string path_;
+    mapped_file file_;
+    bool is_open_ = false;
+
+    nav_ch_header header_{};
+    const uint32_t* ranks_ = nullptr;
+    const uint32_t* up_offsets_ = nullptr;
+    const uint32_t* up_targets_ = nullptr;
+    const double* up_weights_ = nullptr;
+    const uint32_t* up_middles_ = nullptr;
+};
+
+// Shortest routes on a contraction hierarchy, by a bidirectional Dijkstra over upward edges that stops once
+// neither side can improve on the best meeting node. One query object per thread, like nav_path_engine.
+class nav_ch_query {
+public:
+    explicit nav_ch_query(const nav_ch& ch)
+        : ch_(ch) {
+        for (auto& side : sides_) {
+            side.dist.resize(ch.num_nodes());
+            side.parent_edge.resize(ch.num_nodes());
+            side.parent.resize(ch.num_nodes());
+            side.seen.assign(ch.num_nodes(), 0);
+        }
+    }
+
+    nav_path_engine::route find_path(const uint32_t start, const uint32_t goal) {
+        nav_path_engine::route result;
+        if (ch_.num_nodes() <= start || ch_.num_nodes() <= goal) {
+            return result;
+        }
+        if (++generation_ == 0) {
+            for (auto& side : sides_) {
+                std::fill(side.seen.begin(), side.seen.end(), 0);
+            }
+            generation_ = 1;
+        }
+        auto& forward = sides_[0];
+        auto& backward = sides_[1];
+        for (auto& side : sides_) {
+            side.heap.clear();
+        }
+        reach(forward, start, nav_graph::npos, nav_graph::npos, 0.0);
+        reach(backward, goal, nav_graph::npos, nav_graph::npos, 0.0);
+
+        double best = std::numeric_limits<double>::infinity();
+        uint32_t meeting = nav_graph::npos;
+        bool forward_turn = true;
+        while (true) {
+            const bool forward_done = forward.heap.empty() || best <= forward.heap.front().first;
+            const bool backward_done = backward.heap.empty() || best <= backward.heap.front().first;
+            if (forward_done && backward_done) {
+                break;
+            }
+            auto& side = (forward_turn && !forward_done) || backward_done ? forward : backward;
+            const auto& other = &side == &forward ? backward : forward;
+            forward_turn = !forward_turn;
+
+            std::pop_heap(side.heap.begin(), side.heap.end(), std::greater<std::pair<double, uint32_t>>());
+            const auto top = side.heap.back();
+            side.heap.pop_back();
+            const auto node = top.second;
+            if (side.dist[node] < top.first) {
+                continue;
+            }
+            ++result.num_expanded;
+            if (other.seen[node] == generation_ && side.dist[node] + other.dist[node] < best) {
+                best = side.dist[node] + other.dist[node];
+                meeting = node;
+            }
+            if (stalled(side, node)) {
+                continue;
+            }
+            for (auto e = ch_.up_begin(node); e < ch_.up_end(node); ++e) {
+                reach(side, ch_.target(e), node, e, side.dist[node] + ch_.weight(e));
+            }
+        }
+        if (meeting == nav_graph::npos) {
+            return result;
+        }
+
+        // the upward chains from both ends to the meeting node, with every shortcut unpacked
+        std::vector<uint32_t> chain;
+        for (auto node = meeting; node != nav_graph::npos; node = forward.parent[node]) {
+            chain.push_back(node);
+        }
+        std::reverse(chain.begin(), chain.end());
+        for (auto node = backward.parent[meeting]; node != nav_graph::npos; node = backward.parent[node]) {
+            chain.push_back(node);
+        }
+        result.nodes.push_back(chain.front());
+        for (size_t i = 0; i + 1 < chain.size(); ++i) {
+            unpack(chain[i], chain[i + 1], result.nodes);
+        }
+        result.distance = best;
+        return result;
+    }
+
+private:
+    struct search_side {
+        std::vector<double> dist;
+        std::vector<uint32_t> parent_edge;
+        std::vector<uint32_t> parent;
+        std::vector<uint32_t> seen;
+        std::vector<std::pair<double, uint32_t>> heap;
+    };
+
+    void reach(search_side& side, const uint32_t node, const uint32_t parent, const uint32_t edge, const double dist) {
+        if (side.seen[node] == generation_ && side.dist[node] <= dist) {
+            return;
+        }
+        side.seen[node] = generation_;
+        side.dist[node] = dist;
+        side.parent[node] = parent;
+        side.parent_edge[node] = edge;
+        side.heap.emplace_back(dist, node);
+        std::push_heap(side.heap.begin(), side.heap.end(), std::greater<std::pair<double, uint32_t>>());
+    }
+
+    // Stall-on-demand: a node reached more cheaply through a more important neighbour is not on a shortest
+    // upward path, so its edges need not be relaxed
+    bool stalled(const search_side& side, const uint32_t node) const {
+        for (auto e = ch_.up_begin(node); e < ch_.up_end(node); ++e) {
+            const auto neighbour = ch_.target(e);
+            if (side.seen[neighbour] == generation_ && side.dist[neighbour] + ch_.weight(e) < side.dist[node]) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Appends the keyframes after from up to and including to, expanding shortcuts through the nodes they bypass
+    void unpack(const uint32_t from, const uint32_t to, std::vector<uint32_t>& nodes) const {
+        const auto e = ch_.find_edge(from, to);
+        const auto middle = e == nav_graph::npos ? nav_graph::npos : ch_.middle(e);
+        if (middle == nav_graph::npos) {
+            nodes.push_back(to);
+            return;
+        }
+        unpack(from, middle, nodes);
+        unpack(middle, to, nodes);
+    }
+
+    const nav_ch& ch_;
+    search_side sides_[2];
+    uint32_t generation_ = 0;
+};
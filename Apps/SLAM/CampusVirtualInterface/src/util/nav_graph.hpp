@@ -0,0 +1,432 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "map_db_reader.hpp"
+#include "mapped_file.hpp"
+
+// Navigation graph file, the keyframe graph of the nodes/edges/node_locations tables in compressed sparse row form.
+// Nodes are stored sorted by keyframe id and addressed by their index in that order. Every section starts on a
+// 64 byte boundary and is read in place from a read-only mapping, values are in the host's (little endian) order.
+//
+//   header
+//   ids             uint32[num_nodes]      keyframe ids, ascending
+//   x, y, z         double[num_nodes] x3   camera centres in world coordinates (x_trans, y_trans, z_trans)
+//   location_ids    uint32[num_nodes]      index into the location names, nav_graph::npos for none
+//   row_offsets     uint32[num_nodes + 1]  edges of node i are [row_offsets[i], row_offsets[i + 1])
+//   targets         uint32[num_edges]      neighbour node index, spanning edges of a node before its loop edges
+//   edge_types      uint8[num_edges]       0 = spanning tree, 1 = loop closure, as in the edges table
+//   name_offsets    uint32[num_locations + 1]
+//   names           char[]                 location names, back to back
+struct nav_graph_header {
+    char magic[4];
+    uint32_t version;
+    uint32_t num_nodes;
+    uint32_t num_edges; // directed, every edge is stored from both ends
+    uint32_t num_locations;
+    uint32_t reserved;
+    uint64_t ids_offset;
+    uint64_t x_offset;
+    uint64_t y_offset;
+    uint64_t z_offset;
+    uint64_t location_ids_offset;
+    uint64_t row_offsets_offset;
+    uint64_t targets_offset;
+    uint64_t edge_types_offset;
+    uint64_t name_offsets_offset;
+    uint64_t names_offset;
+    uint64_t file_size;
+};
+
+constexpr char nav_graph_magic[4] = {'C', 'V', 'N', 'G'};
+constexpr uint32_t nav_graph_version = 1;
+
+// Collects a map with the same calls as pg_map_exporter and writes it as a navigation graph file.
+// Duplicates are handled the same way: the first node, edge and location wins, edges to unknown keyframes are dropped.
+class nav_graph_builder {
+public:
+    bool add_node(const map_keyframe& keyfrm) {
+        if (!node_index_.emplace(keyfrm.id, static_cast<uint32_t>(nodes_.size())).second) {
+            return false;
+        }
+        nodes_.push_back({keyfrm.id, keyfrm.trans_wc, std::numeric_limits<uint32_t>::max()});
+        return true;
+    }
+
+    // Adds the edge in both directions
+    void add_edge(const unsigned int keyfrm_id, const unsigned int other_id, const int type) {
+        const auto it0 = node_index_.find(keyfrm_id);
+        const auto it1 = node_index_.find(other_id);
+        if (it0 == node_index_.end() || it1 == node_index_.end() || keyfrm_id == other_id) {
+            return;
+        }
+        if (edge_keys_.insert((static_cast<uint64_t>(keyfrm_id) << 32) | other_id).second) {
+            edges_.emplace_back(it0->second, it1->second, static_cast<uint8_t>(type));
+        }
+        if (edge_keys_.insert((static_cast<uint64_t>(other_id) << 32) | keyfrm_id).second) {
+            edges_.emplace_back(it1->second, it0->second, static_cast<uint8_t>(type));
+        }
+    }
+
+    bool add_location(const unsigned int keyfrm_id, const std::string& location) {
+        const auto it = node_index_.find(keyfrm_id);
+        if (it == node_index_.end() || nodes_[it->second].location_id != std::numeric_limits<uint32_t>::max()) {
+            return false;
+        }
+        auto name_it = location_index_.find(location);
+        if (name_it == location_index_.end()) {
+            name_it = location_index_.emplace(location, static_cast<uint32_t>(location_names_.size())).first;
+            location_names_.push_back(location);
+        }
+        nodes_[it->second].location_id = name_it->second;
+        return true;
+    }
+
+    size_t num_nodes() const {
+        return nodes_.size();
+    }
+
+    size_t num_edges() const {
+        return edges_.size();
+    }
+
+    // Keyframe id, position and location of the node-th node added, the location is empty if it has none
+    unsigned int id(const size_t node) const {
+        return nodes_[node].id;
+    }
+
+    const std::array<double, 3>& position(const size_t node) const {
+        return nodes_[node].trans_wc;
+    }
+
+    const std::string& location(const size_t node) const {
+        static const std::string none;
+        const auto location_id = nodes_[node].location_id;
+        return location_id == std::numeric_limits<uint32_t>::max() ? none : location_names_[location_id];
+    }
+
+    bool write(const std::string& path) const {
+        // order the nodes by keyframe id, and the edges by source node, type and target
+        std::vector<uint32_t> order(nodes_.size());
+        for (uint32_t i = 0; i < order.size(); ++i) {
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), [this](const uint32_t a, const uint32_t b) {
+            return nodes_[a].id < nodes_[b].id;
+        });
+        std::vector<uint32_t> sorted_index(nodes_.size());
+        for (uint32_t i = 0; i < order.size(); ++i) {
+            sorted_index[order[i]] = i;
+        }
+        std::vector<std::tuple<uint32_t, uint8_t, uint32_t>> edges;
+        edges.reserve(edges_.size());
+        for (const auto& edge : edges_) {
+            edges.emplace_back(sorted_index[std::get<0>(edge)], std::get<2>(edge), sorted_index[std::get<1>(edge)]);
+        }
+        std::sort(edges.begin(), edges.end());
+
+        const auto num_nodes = static_cast<uint32_t>(nodes_.size());
+        const auto num_edges = static_cast<uint32_t>(edges.size());
+        std::vector<uint32_t> ids(num_nodes), location_ids(num_nodes), row_offsets(num_nodes + 1, 0), targets(num_edges);
+        std::vector<double> x(num_nodes), y(num_nodes), z(num_nodes);
+        std::vector<uint8_t> edge_types(num_edges);
+        for (uint32_t i = 0; i < num_nodes; ++i) {
+            const auto& node = nodes_[order[i]];
+            ids[i] = node.id;
+            x[i] = node.trans_wc[0];
+            y[i] = node.trans_wc[1];
+            z[i] = node.trans_wc[2];
+            location_ids[i] = node.location_id;
+        }
+        for (uint32_t k = 0; k < num_edges; ++k) {
+            ++row_offsets[std::get<0>(edges[k]) + 1];
+            edge_types[k] = std::get<1>(edges[k]);
+            targets[k] = std::get<2>(edges[k]);
+        }
+        for (uint32_t i = 0; i < num_nodes; ++i) {
+            row_offsets[i + 1] += row_offsets[i];
+        }
+        std::vector<uint32_t> name_offsets(1, 0);
+        std::string names;
+        for (const auto& name : location_names_) {
+            names += name;
+            name_offsets.push_back(static_cast<uint32_t>(names.size()));
+        }
+
+        nav_graph_header header{};
+        std::memcpy(header.magic, nav_graph_magic, sizeof(header.magic));
+        header.version = nav_graph_version;
+        header.num_nodes = num_nodes;
+        header.num_edges = num_edges;
+        header.num_locations = static_cast<uint32_t>(location_names_.size());
+        uint64_t offset = sizeof(header);
+        const auto place = [&offset](const size_t num_bytes) {
+            offset = (offset + 63) & ~uint64_t(63);
+            const auto section = offset;
+            offset += num_bytes;
+            return section;
+        };
+        header.ids_offset = place(ids.size() * sizeof(uint32_t));
+        header.x_offset = place(x.size() * sizeof(double));
+        header.y_offset = place(y.size() * sizeof(double));
+        header.z_offset = place(z.size() * sizeof(double));
+        header.location_ids_offset = place(location_ids.size() * sizeof(uint32_t));
+        header.row_offsets_offset = place(row_offsets.size() * sizeof(uint32_t));
+        header.targets_offset = place(targets.size() * sizeof(uint32_t));
+        header.edge_types_offset = place(edge_types.size());
+        header.name_offsets_offset = place(name_offsets.size() * sizeof(uint32_t));
+        header.names_offset = place(names.size());
+        header.file_size = offset;
+
+        std::ofstream ofs(path, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!ofs.is_open()) {
+            spdlog::error("Unable to write the navigation graph {}", path);
+            return false;
+        }
+        uint64_t written = 0;
+        const auto write_section = [&ofs, &written](const uint64_t section, const void* data, const size_t num_bytes) {
+            static const char padding[64] = {};
+            ofs.write(padding, static_cast<std::streamsize>(section - written));
+            ofs.write(static_cast<const char*>(data), static_cast<std::streamsize>(num_bytes));
+            written = section + num_bytes;
+        };
+        write_section(0, &header, sizeof(header));
+        write_section(header.ids_offset, ids.data(), ids.size() * sizeof(uint32_t));
+        write_section(header.x_offset, x.data(), x.size() * sizeof(double));
+        write_section(header.y_offset, y.data(), y.size() * sizeof(double));
+        write_section(header.z_offset, z.data(), z.size() * sizeof(double));
+        write_section(header.location_ids_offset, location_ids.data(), location_ids.size() * sizeof(uint32_t));
+        write_section(header.row_offsets_offset, row_offsets.data(), row_offsets.size() * sizeof(uint32_t));
+        write_section(header.targets_offset, targets.data(), targets.size() * sizeof(uint32_t));
+        write_section(header.edge_types_offset, edge_types.data(), edge_types.size());
+        write_section(header.name_offsets_offset, name_offsets.data(), name_offsets.size() * sizeof(uint32_t));
+        write_section(header.names_offset, names.data(), names.size());
+        ofs.close();
+        if (!ofs) {
+            spdlog::error("Unable to write the navigation graph {}", path);
+            return false;
+        }
+        return true;
+    }
+
+private:
+    struct node {
+        unsigned int id;
+        std::array<double, 3> trans_wc;
+        uint32_t location_id;
+    };
+
+    std::vector<node> nodes_;
+    std::unordered_map<unsigned int, uint32_t> node_index_;
+    std::vector<std::tuple<uint32_t, uint32_t, uint8_t>> edges_;
+    std::unordered_set<uint64_t> edge_keys_;
+    std::vector<std::string> location_names_;
+    std::unordered_map<std::string, uint32_t> location_index_;
+};
+
+// Read-only view of a navigation graph file, mapped rather than loaded so opening it costs a page fault per
+// touched page and several processes share one copy. Nodes are addressed by index, find() maps a keyframe id
+// to its index in O(log n) and neighbours() is a slice of the CSR arrays.
+class nav_graph {
+public:
+    static constexpr uint32_t npos = std::numeric_limits<uint32_t>::max();
+
+    // Neighbours of one node, spanning edges first
+    struct edge_range {
+        const uint32_t* targets = nullptr;
+        const uint8_t* types = nullptr;
+        uint32_t count = 0;
+
+        uint32_t size() const {
+            return count;
+        }
+        const uint32_t* begin() const {
+            return targets;
+        }
+        const uint32_t* end() const {
+            return targets + count;
+        }
+        uint32_t operator[](const uint32_t k) const {
+            return targets[k];
+        }
+        uint8_t type(const uint32_t k) const {
+            return types[k];
+        }
+    };
+
+    explicit nav_graph(const std::string& path)
+        : path_(path), file_(path) {
+        is_open_ = file_.is_mapped() && validate();
+    }
+
+    nav_graph(const nav_graph&) = delete;
+    nav_graph& operator=(const nav_graph&) = delete;
+
+    bool is_open() const {
+        return is_open_;
+    }
+
+    uint32_t num_nodes() const {
+        return header_.num_nodes;
+    }
+
+    uint32_t num_edges() const {
+        return header_.num_edges;
+    }
+
+    uint32_t num_locations() const {
+        return header_.num_locations;
+    }
+
+    // Index of the node with this keyframe id, npos if there is none
+    uint32_t find(const unsigned int keyfrm_id) const {
+        const auto* end = ids_ + header_.num_nodes;
+        const auto* it = std::lower_bound(ids_, end, keyfrm_id);
+        return (it != end && *it == keyfrm_id) ? static_cast<uint32_t>(it - ids_) : npos;
+    }
+
+    unsigned int id(const uint32_t node) const {
+        return ids_[node];
+    }
+
+    const uint32_t* ids() const {
+        return ids_;
+    }
+
+    // Coordinates as arrays over all nodes
+    const double* x() const {
+        return x_;
+    }
+    const double* y() const {
+        return y_;
+    }
+    const double* z() const {
+        return z_;
+    }
+
+    std::array<double, 3> position(const uint32_t node) const {
+        return {x_[node], y_[node], z_[node]};
+    }
+
+    double distance(const uint32_t node0, const uint32_t node1) const {
+        const double dx = x_[node0] - x_[node1];
+        const double dy = y_[node0] - y_[node1];
+        const double dz = z_[node0] - z_[node1];
+        return std::sqrt(dx * dx + dy * dy + dz * dz);
+    }
+
+    edge_range neighbours(const uint32_t node) const {
+        const auto first = row_offsets_[node];
+        return {targets_ + first, edge_types_ + first, row_offsets_[node + 1] - first};
+    }
+
+    // Index into the location names, npos if the keyframe has no location
+    uint32_t location_id(const uint32_t node) const {
+        return location_ids_[node];
+    }
+
+    std::string_view location_name(const uint32_t location) const {
+        return {names_ + name_offsets_[location], name_offsets_[location + 1] - name_offsets_[location]};
+    }
+
+    // Location of a node, empty if it has none
+    std::string_view location(const uint32_t node) const {
+        const auto location = location_ids_[node];
+        return location == npos ? std::string_view() : location_name(location);
+    }
+
+    // Index of a location name, npos if no keyframe has it
+    uint32_t find_location(const std::string_view name) const {
+        for (uint32_t location = 0; location < header_.num_locations; ++location) {
+            if (location_name(location) == name) {
+                return location;
+            }
+        }
+        return npos;
+    }
+
+private:
+    // Checks the header and every index, so lookups need no bounds checks afterwards.
+    // Every failure resets the header, so an unopened file reads as empty rather than as the counts it claims
+    bool validate() {
+        if (file_.size() < sizeof(header_)) {
+            spdlog::error("{} is not a navigation graph", path_);
+            header_ = {};
+            return false;
+        }
+        std::memcpy(&header_, file_.data(), sizeof(header_));
+        if (std::memcmp(header_.magic, nav_graph_magic, sizeof(header_.magic)) != 0 || header_.version != nav_graph_version) {
+            spdlog::error("{} is not a navigation graph of version {}", path_, nav_graph_version);
+            header_ = {};
+            return false;
+        }
+        const uint64_t n = header_.num_nodes;
+        const uint64_t m = header_.num_edges;
+        const uint64_t l = header_.num_locations;
+        const bool sections_ok = header_.file_size == file_.size()
+                                 && file_.section(header_.ids_offset, n, ids_)
+                                 && file_.section(header_.x_offset, n, x_)
+                                 && file_.section(header_.y_offset, n, y_)
+                                 && file_.section(header_.z_offset, n, z_)
+                                 && file_.section(header_.location_ids_offset, n, location_ids_)
+                                 && file_.section(header_.row_offsets_offset, n + 1, row_offsets_)
+                                 && file_.section(header_.targets_offset, m, targets_)
+                                 && file_.section(header_.edge_types_offset, m, edge_types_)
+                                 && file_.section(header_.name_offsets_offset, l + 1, name_offsets_)
+                                 && file_.section(header_.names_offset, 0, names_);
+        if (!sections_ok) {
+            spdlog::error("{} is truncated or corrupt", path_);
+            header_ = {};
+            return false;
+        }
+        bool indices_ok = row_offsets_[0] == 0 && row_offsets_[n] == m && name_offsets_[0] == 0
+                          && name_offsets_[l] <= file_.size() - header_.names_offset;
+        for (uint64_t i = 0; indices_ok && i < n; ++i) {
+            indices_ok = row_offsets_[i] <= row_offsets_[i + 1] && (i == 0 || ids_[i - 1] < ids_[i])
+                         && (location_ids_[i] == npos || location_ids_[i] < l);
+        }
+        for (uint64_t k = 0; indices_ok && k < m; ++k) {
+            indices_ok = targets_[k] < n;
+        }
+        for (uint64_t k = 0; indices_ok && k < l; ++k) {
+            indices_ok = name_offsets_[k] <= name_offsets_[k + 1];
+        }
+        if (!indices_ok) {
+            spdlog::error("{} has out of range indices", path_);
+            header_ = {};
+            return false;
+        }
+        return true;
+    }
+
+    std::string path_;
+    mapped_file file_;
+    bool is_open_ = false;
+
+    nav_graph_header header_{};
+    const uint32_t* ids_ = nullptr;
+    const double* x_ = nullptr;
+    const double* y_ = nullptr;
+    const double* z_ = nullptr;
+    const uint32_t* location_ids_ = nullptr;
+    const uint32_t* row_offsets_ = nullptr;
+    const uint32_t* targets_ = nullptr;
+    const uint8_t* edge_types_ = nullptr;
+    const uint32_t* name_offsets_ = nullptr;
+    const char* names_ = nullptr;
+};
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "nav_graph.hpp"
+
+// Shortest paths over a nav_graph, with edges weighted by the world-frame distance between their keyframes.
+// The per-node search state is kept between queries and invalidated by bumping a generation counter, so a query
+// only touches the nodes it explores. One engine per thread, the graph itself can be shared.
+class nav_path_engine {
+public:
+    struct route {
+        std::vector<uint32_t> nodes; // node indices from the start to the end of the route, empty if there is none
+        double distance = 0.0;
+        uint32_t num_expanded = 0;
+    };
+
+    explicit nav_path_engine(const nav_graph& graph)
+        : graph_(graph),
+          g_(graph.num_nodes()),
+          h_(graph.num_nodes()),
+          parent_(graph.num_nodes()),
+          seen_(graph.num_nodes(), 0),
+          closed_(graph.num_nodes(), 0) {}
+
+    // A* from start to goal with the straight-line distance to the goal as heuristic.
+    // With a target location the search also stops at the first node it expands that has that location,
+    // like the backend's firstWith, and the route ends there.
+    route find_path(const uint32_t start, const uint32_t goal, const uint32_t target_location = nav_graph::npos) {
+        return search(start, goal, target_location);
+    }
+
+    // Dijkstra from start to the nearest node, along the graph, that has the location
+    route find_nearest(const uint32_t start, const uint32_t location) {
+        return search(start, nav_graph::npos, location);
+    }
+
+private:
+    route search(const uint32_t start, const uint32_t goal, const uint32_t target_location) {
+        route result;
+        if (graph_.num_nodes() <= start || (goal != nav_graph::npos && graph_.num_nodes() <= goal)) {
+            return result;
+        }
+        if (++generation_ == 0) {
+            std::fill(seen_.begin(), seen_.end(), 0);
+            std::fill(closed_.begin(), closed_.end(), 0);
+            generation_ = 1;
+        }
+        heap_.clear();
+
+        visit(start, nav_graph::npos, 0.0, goal);
+        while (!heap_.empty()) {
+            std::pop_heap(heap_.begin(), heap_.end(), std::greater<std::pair<double, uint32_t>>());
+            const auto node = heap_.back().second;
+            heap_.pop_back();
+            if (closed_[node] == generation_) {
+                continue; // stale entry, the node was reached more cheaply
+            }
+            closed_[node] = generation_;
+            ++result.num_expanded;
+
+            if (node == goal || (target_location != nav_graph::npos && graph_.location_id(node) == target_location)) {
+                result.distance = g_[node];
+                for (auto n = node; n != nav_graph::npos; n = parent_[n]) {
+                    result.nodes.push_back(n);
+                }
+                std::reverse(result.nodes.begin(), result.nodes.end());
+                return result;
+            }
+
+            for (const auto neighbour : graph_.neighbours(node)) {
+                if (closed_[neighbour] != generation_) {
+                    visit(neighbour, node, g_[node] + graph_.distance(node, neighbour), goal);
+                }
+            }
+        }
+        return result;
+    }
+
+    void visit(const uint32_t node, const uint32_t parent, const double g, const uint32_t goal) {
+        if (seen_[node] == generation_ && g_[node] <= g) {
+            return;
+        }
+        if (seen_[node] != generation_) {
+            seen_[node] = generation_;
+            h_[node] = goal == nav_graph::npos ? 0.0 : graph_.distance(node, goal);
+        }
+        g_[node] = g;
+        parent_[node] = parent;
+        heap_.emplace_back(g + h_[node], node);
+        std::push_heap(heap_.begin(), heap_.end(), std::greater<std::pair<double, uint32_t>>());
+    }
+
+    const nav_graph& graph_;
+    std::vector<double> g_;
+    std::vector<double> h_;
+    std::vector<uint32_t> parent_;
+    std::vector<uint32_t> seen_;
+    std::vector<uint32_t> closed_;
+    uint32_t generation_ = 0;
+    std::vector<std::pair<double, uint32_t>> heap_;
+};
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+// Drop a file's clean pages from the page cache so the next read comes from disk, for cold start measurements
+inline bool evict_from_page_cache(const std::string& path) {
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    const bool ok = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    close(fd);
+    return ok;
+}
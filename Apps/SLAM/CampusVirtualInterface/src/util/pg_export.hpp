@@ -0,0 +1,294 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <pqxx/pqxx>
+#include <spdlog/spdlog.h>
+
+#include "map_db_reader.hpp"
+
+// stream_to::raw_table() replaced the table name constructor in libpqxx 7.7
+#if PQXX_VERSION_MAJOR > 7 || (PQXX_VERSION_MAJOR == 7 && PQXX_VERSION_MINOR >= 7)
+#define PG_EXPORT_HAS_STREAM_TO_TABLE
+#endif
+
+// Starts a COPY ... FROM STDIN into table, columns is a comma separated list of plain column names
+inline std::unique_ptr<pqxx::stream_to> open_copy_stream(pqxx::work& txn, const std::string& table, const std::string& columns) {
+#ifdef PG_EXPORT_HAS_STREAM_TO_TABLE
+    return std::make_unique<pqxx::stream_to>(pqxx::stream_to::raw_table(txn, table, columns));
+#else
+    std::vector<std::string> column_list;
+    size_t begin = 0;
+    while (begin < columns.size()) {
+        auto end = columns.find(',', begin);
+        if (end == std::string::npos) {
+            end = columns.size();
+        }
+        auto column = columns.substr(begin, end - begin);
+        column.erase(0, column.find_first_not_of(' '));
+        column.erase(column.find_last_not_of(' ') + 1);
+        column_list.push_back(column);
+        begin = end + 1;
+    }
+    return std::unique_ptr<pqxx::stream_to>(new pqxx::stream_to(txn, table, column_list));
+#endif
+}
+
+// Postgres array literal of integers, for passing id lists as a single parameter
+template<typename T>
+std::string pg_int_array(const std::vector<T>& values) {
+    std::string array = "{";
+    char buffer[24];
+    for (size_t i = 0; i < values.size(); ++i) {
+        if (i != 0) {
+            array += ',';
+        }
+        array.append(buffer, std::to_chars(buffer, buffer + sizeof(buffer), values[i]).ptr);
+    }
+    array += '}';
+    return array;
+}
+
+// Pairs timestamps with the keyframe taken at that time.
+// Timestamps are keyed as integer microseconds, and the queries and keyframes are both sorted and merge-joined,
+// so pairing M timestamps with N keyframes costs two sorts and one linear pass instead of a scan per timestamp.
+class keyframe_timestamp_index {
+public:
+    static int64_t timestamp_key(const double ts) {
+        return std::llround(ts * 1e6);
+    }
+
+    void add(const double ts, const unsigned int id) {
+        keys_.emplace_back(timestamp_key(ts), id);
+        is_sorted_ = false;
+    }
+
+    // Id of the nearest keyframe for every timestamp, -1 where none is closer than tolerance_us
+    std::vector<long> match(const std::vector<double>& timestamps, const int64_t tolerance_us = 10) {
+        if (!is_sorted_) {
+            std::sort(keys_.begin(), keys_.end());
+            is_sorted_ = true;
+        }
+
+        std::vector<int64_t> query_keys(timestamps.size());
+        std::vector<size_t> order(timestamps.size());
+        for (size_t i = 0; i < timestamps.size(); ++i) {
+            query_keys[i] = timestamp_key(timestamps[i]);
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), [&](const size_t a, const size_t b) {
+            return query_keys[a] < query_keys[b];
+        });
+
+        std::vector<long> ids(timestamps.size(), -1);
+        size_t first = 0;
+        for (const auto i : order) {
+            const int64_t key = query_keys[i];
+            while (first < keys_.size() && keys_[first].first <= key - tolerance_us) {
+                ++first;
+            }
+            int64_t best_diff = tolerance_us;
+            for (size_t k = first; k < keys_.size() && keys_[k].first < key + tolerance_us; ++k) {
+                const int64_t diff = std::abs(keys_[k].first - key);
+                if (diff < best_diff) {
+                    best_diff = diff;
+                    ids[i] = keys_[k].second;
+                }
+            }
+        }
+        return ids;
+    }
+
+private:
+    std::vector<std::pair<int64_t, unsigned int>> keys_;
+    bool is_sorted_ = true;
+};
+
+enum class pg_export_method_t {
+    COPY,  // COPY ... FROM STDIN through pqxx::stream_to
+    INSERT // one INSERT round trip per row, the original export
+};
+
+inline pg_export_method_t pg_export_method_from_string(const std::string& method) {
+    if (method == "copy") {
+        return pg_export_method_t::COPY;
+    }
+    if (method == "insert") {
+        return pg_export_method_t::INSERT;
+    }
+    throw std::invalid_argument("Invalid export method: " + method + " (expected copy or insert)");
+}
+
+// Formats a Postgres array literal of doubles into a fixed buffer, so building a row allocates nothing.
+// std::to_chars writes the shortest text that reads back to the same double.
+class pg_double_array_formatter {
+public:
+    template<size_t N>
+    const char* format(const std::array<double, N>& values) {
+        static_assert(N * max_chars_per_value + 3 <= sizeof(buffer_), "array too long for the buffer");
+        char* out = buffer_;
+        *out++ = '{';
+        for (size_t i = 0; i < N; ++i) {
+            if (i != 0) {
+                *out++ = ',';
+            }
+            out = std::to_chars(out, buffer_ + sizeof(buffer_) - 2, values[i]).ptr;
+        }
+        *out++ = '}';
+        *out = '\0';
+        return buffer_;
+    }
+
+private:
+    static constexpr size_t max_chars_per_value = 25; // -d.ddddddddddddddddde-308 plus the separator
+    char buffer_[16 * max_chars_per_value + 3];
+};
+
+// Writes the nodes, edges and node_locations of a map inside one transaction, table by table.
+// With COPY each table is a single stream that cannot use ON CONFLICT, so rows are deduplicated here instead
+// and the first row for a keyframe, an edge or a location wins, for both export methods.
+class pg_map_exporter {
+public:
+    struct export_stats {
+        unsigned long num_nodes = 0;
+        unsigned long num_edges = 0;
+        unsigned long num_locations = 0;
+    };
+
+    pg_map_exporter(pqxx::work& txn, const pg_export_method_t method)
+        : txn_(txn), method_(method) {}
+
+    pg_map_exporter(const pg_map_exporter&) = delete;
+    pg_map_exporter& operator=(const pg_map_exporter&) = delete;
+
+    // Nodes must all be added before the first edge, edges before the first location
+    bool add_node(const map_keyframe& keyfrm) {
+        if (!node_ids_.insert(keyfrm.id).second) {
+            spdlog::warn("Keyframe {} is in more than one map, keeping the first", keyfrm.id);
+            return false;
+        }
+        node_timestamps_.add(keyfrm.timestamp, keyfrm.id);
+        const char* pose = pose_formatter_.format(keyfrm.pose_cw);
+        if (method_ == pg_export_method_t::COPY) {
+            if (!stream_) {
+                stream_ = open_copy_stream(txn_, "nodes", "keyframe_id, ts, pose, x_trans, y_trans, z_trans");
+            }
+            *stream_ << std::make_tuple(keyfrm.id, keyfrm.timestamp, pose, keyfrm.trans_wc[0], keyfrm.trans_wc[1], keyfrm.trans_wc[2]);
+        }
+        else {
+            txn_.exec_params("INSERT INTO nodes (keyframe_id, ts, pose, x_trans, y_trans, z_trans) VALUES ($1, $2, $3, $4, $5, $6)",
+                             keyfrm.id, keyfrm.timestamp, pose, keyfrm.trans_wc[0], keyfrm.trans_wc[1], keyfrm.trans_wc[2]);
+        }
+        ++stats_.num_nodes;
+        return true;
+    }
+
+    bool has_node(const unsigned int id) const {
+        return node_ids_.count(id) != 0;
+    }
+
+    // Adds the edge in both directions, edges to unknown keyframes are dropped
+    void add_edge(const unsigned int keyfrm_id, const unsigned int other_id, const int type) {
+        if (phase_ < phase_t::EDGES) {
+            finish_stream();
+            phase_ = phase_t::EDGES;
+        }
+        if (!has_node(other_id) || !has_node(keyfrm_id)) {
+            return;
+        }
+        write_edge(keyfrm_id, other_id, type);
+        write_edge(other_id, keyfrm_id, type);
+    }
+
+    // Keyframe id for every timestamp, -1 where no keyframe was taken within 10us
+    std::vector<long> match_timestamps(const std::vector<double>& timestamps) {
+        return node_timestamps_.match(timestamps);
+    }
+
+    // Labels a keyframe with its location, a keyframe keeps its first label
+    bool add_location(const unsigned int keyfrm_id, const std::string& location) {
+        if (phase_ < phase_t::LOCATIONS) {
+            finish_stream();
+            phase_ = phase_t::LOCATIONS;
+        }
+        if (!has_node(keyfrm_id) || !located_ids_.insert(keyfrm_id).second) {
+            return false;
+        }
+        if (method_ == pg_export_method_t::COPY) {
+            if (!stream_) {
+                stream_ = open_copy_stream(txn_, "node_locations", "keyframe_id, location");
+            }
+            *stream_ << std::make_tuple(keyfrm_id, location);
+        }
+        else {
+            txn_.exec_params("INSERT INTO node_locations (keyframe_id, location) VALUES ($1, $2)", keyfrm_id, location);
+        }
+        ++stats_.num_locations;
+        return true;
+    }
+
+    // Completes the open COPY, the transaction can run other statements afterwards
+    void finish() {
+        finish_stream();
+        phase_ = phase_t::DONE;
+    }
+
+    const export_stats& get_stats() const {
+        return stats_;
+    }
+
+private:
+    enum class phase_t {
+        NODES,
+        EDGES,
+        LOCATIONS,
+        DONE
+    };
+
+    void write_edge(const unsigned int id0, const unsigned int id1, const int type) {
+        if (!edge_keys_.insert((static_cast<uint64_t>(id0) << 32) | id1).second) {
+            return;
+        }
+        if (method_ == pg_export_method_t::COPY) {
+            if (!stream_) {
+                stream_ = open_copy_stream(txn_, "edges", "keyframe_id0, keyframe_id1, type");
+            }
+            *stream_ << std::make_tuple(id0, id1, type);
+        }
+        else {
+            txn_.exec_params("INSERT INTO edges (keyframe_id0, keyframe_id1, type) VALUES ($1, $2, $3)", id0, id1, type);
+        }
+        ++stats_.num_edges;
+    }
+
+    void finish_stream() {
+        if (stream_) {
+            stream_->complete();
+            stream_.reset();
+        }
+    }
+
+    pqxx::work& txn_;
+    const pg_export_method_t method_;
+    phase_t phase_ = phase_t::NODES;
+    std::unique_ptr<pqxx::stream_to> stream_;
+    pg_double_array_formatter pose_formatter_;
+
+    std::unordered_set<unsigned int> node_ids_;
+    keyframe_timestamp_index node_timestamps_;
+    std::unordered_set<uint64_t> edge_keys_;
+    std::unordered_set<unsigned int> located_ids_;
+
+    export_stats stats_;
+};
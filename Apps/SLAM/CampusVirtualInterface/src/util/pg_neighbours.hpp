@@ -0,0 +1,154 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <pqxx/pqxx>
+#include <spdlog/spdlog.h>
+
+#include "nav_graph.hpp"
+#include "pg_export.hpp"
+#include "spatial_grid.hpp"
+
+// Bounded lists of the keyframes physically close to each keyframe, so clients read them by primary key instead of
+// scanning nodes for every request. Thresholds are in metres, with the defaults of the GraphPruner's consts.ts:
+// a pair of keyframes that are both outdoors uses the outdoors thresholds, any other pair the indoor ones.
+struct neighbour_params {
+    double radius = 5.0;            // TARGET_CLOSENESS, on the XZ plane
+    double y_dist = 2.0;            // Y_DIST_THRESHOLD
+    double outdoors_radius = 7.0;   // OUTDOORS_TARGET_CLOSENESS
+    double outdoors_y_dist = 2.0;   // OUTDOORS_Y_DIST_THRESHOLD
+    double coords_to_metres = 10.0; // COORDS_TO_METRES
+    std::string outdoors_location = "outdoors";
+    unsigned int max_neighbours = 16;
+    unsigned int num_threads = 0; // 0 for one per core
+};
+
+struct keyframe_neighbour {
+    uint32_t node;
+    double distance; // on the XZ plane, in metres
+    double y_dist;   // in metres
+};
+
+// Neighbour lists of the nodes of graph, nearest first: the neighbours of node i are
+// neighbours[i * max_neighbours, i * max_neighbours + counts[i]). Nodes are split between threads in blocks,
+// each writing only its own nodes' slots.
+class neighbour_lists {
+public:
+    neighbour_lists(const nav_graph_builder& graph, const neighbour_params& params)
+        : max_neighbours_(params.max_neighbours) {
+        const auto num_nodes = static_cast<uint32_t>(graph.num_nodes());
+        counts_.assign(num_nodes, 0);
+        if (num_nodes == 0 || max_neighbours_ == 0) {
+            return;
+        }
+        neighbours_.resize(static_cast<size_t>(num_nodes) * max_neighbours_);
+
+        std::vector<double> x(num_nodes), y(num_nodes), z(num_nodes);
+        std::vector<uint8_t> outdoors(num_nodes);
+        for (uint32_t node = 0; node < num_nodes; ++node) {
+            const auto& position = graph.position(node);
+            x[node] = position[0];
+            y[node] = position[1];
+            z[node] = position[2];
+            outdoors[node] = graph.location(node) == params.outdoors_location;
+        }
+        // the grid is searched with the wider of the two thresholds, each pair is then held to its own
+        const double max_radius = std::max(params.radius, params.outdoors_radius) / params.coords_to_metres;
+        const double max_y_dist = std::max(params.y_dist, params.outdoors_y_dist) / params.coords_to_metres;
+        const spatial_grid grid(x.data(), y.data(), z.data(), num_nodes, max_radius);
+
+        constexpr uint32_t block_size = 256;
+        std::atomic<uint32_t> next_block(0);
+        const auto worker = [&]() {
+            std::vector<keyframe_neighbour> candidates;
+            while (true) {
+                const auto begin = next_block.fetch_add(block_size);
+                if (num_nodes <= begin) {
+                    return;
+                }
+                const auto end = std::min(num_nodes, begin + block_size);
+                for (auto node = begin; node < end; ++node) {
+                    candidates.clear();
+                    grid.visit_within(x[node], y[node], z[node], max_radius, max_y_dist,
+                                      [&](const uint32_t other, const double dist_sq) {
+                                          if (other == node) {
+                                              return;
+                                          }
+                                          const bool pair_outdoors = outdoors[node] && outdoors[other];
+                                          const double distance = std::sqrt(dist_sq) * params.coords_to_metres;
+                                          const double y_dist = std::abs(y[other] - y[node]) * params.coords_to_metres;
+                                          if (distance <= (pair_outdoors ? params.outdoors_radius : params.radius)
+                                              && y_dist <= (pair_outdoors ? params.outdoors_y_dist : params.y_dist)) {
+                                              candidates.push_back({other, distance, y_dist});
+                                          }
+                                      });
+                    keep_nearest(node, candidates);
+                }
+            }
+        };
+
+        const auto num_threads = std::max(1u, std::min(params.num_threads != 0 ? params.num_threads : std::thread::hardware_concurrency(),
+                                                       num_nodes / block_size + 1));
+        std::vector<std::thread> threads;
+        for (unsigned int i = 1; i < num_threads; ++i) {
+            threads.emplace_back(worker);
+        }
+        worker();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    uint32_t num_nodes() const {
+        return static_cast<uint32_t>(counts_.size());
+    }
+
+    uint32_t count(const uint32_t node) const {
+        return counts_[node];
+    }
+
+    const keyframe_neighbour& neighbour(const uint32_t node, const uint32_t rank) const {
+        return neighbours_[static_cast<size_t>(node) * max_neighbours_ + rank];
+    }
+
+private:
+    // Keeps the max_neighbours nearest candidates, ties broken by node so the lists do not depend on the threads
+    void keep_nearest(const uint32_t node, std::vector<keyframe_neighbour>& candidates) {
+        const auto nearer = [](const keyframe_neighbour& a, const keyframe_neighbour& b) {
+            return std::tie(a.distance, a.node) < std::tie(b.distance, b.node);
+        };
+        const auto count = std::min<size_t>(candidates.size(), max_neighbours_);
+        std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end(), nearer);
+        std::copy(candidates.begin(), candidates.begin() + count, neighbours_.begin() + static_cast<size_t>(node) * max_neighbours_);
+        counts_[node] = static_cast<uint32_t>(count);
+    }
+
+    const uint32_t max_neighbours_;
+    std::vector<uint32_t> counts_;
+    std::vector<keyframe_neighbour> neighbours_;
+};
+
+// Replaces the rows of node_neighbours with the neighbour lists of the graph in one COPY, returns the number of rows
+inline unsigned long neighbours_to_pg(pqxx::work& txn, const nav_graph_builder& graph, const neighbour_params& params) {
+    const neighbour_lists lists(graph, params);
+
+    txn.exec("TRUNCATE TABLE node_neighbours;");
+    auto stream = open_copy_stream(txn, "node_neighbours", "keyframe_id, rank, neighbour_id, distance, y_dist");
+    unsigned long num_rows = 0;
+    for (uint32_t node = 0; node < lists.num_nodes(); ++node) {
+        for (uint32_t rank = 0; rank < lists.count(node); ++rank) {
+            const auto& neighbour = lists.neighbour(node, rank);
+            *stream << std::make_tuple(graph.id(node), rank, graph.id(neighbour.node), neighbour.distance, neighbour.y_dist);
+            ++num_rows;
+        }
+    }
+    stream->complete();
+    return num_rows;
+}
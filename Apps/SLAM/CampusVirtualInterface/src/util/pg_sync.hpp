@@ -0,0 +1,281 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <pqxx/pqxx>
+#include <spdlog/spdlog.h>
+
+#include "map_db_reader.hpp"
+#include "pg_export.hpp"
+
+// Brings the nodes, edges and node_locations tables in line with a map by writing only what differs:
+// new and erased keyframes, poses that moved by more than the tolerance, and added, removed or retyped edges
+// and locations. The desired state is collected with the same rules as pg_map_exporter (first row wins),
+// then apply() diffs it against the tables and writes the changes within the caller's transaction.
+class pg_map_sync {
+public:
+    struct sync_stats {
+        unsigned long nodes_inserted = 0;
+        unsigned long nodes_updated = 0;
+        unsigned long nodes_deleted = 0;
+        unsigned long edges_inserted = 0;
+        unsigned long edges_updated = 0;
+        unsigned long edges_deleted = 0;
+        unsigned long locations_inserted = 0;
+        unsigned long locations_updated = 0;
+        unsigned long locations_deleted = 0;
+
+        unsigned long rows_touched() const {
+            return nodes_inserted + nodes_updated + nodes_deleted
+                   + edges_inserted + edges_updated + edges_deleted
+                   + locations_inserted + locations_updated + locations_deleted;
+        }
+    };
+
+    pg_map_sync(pqxx::work& txn, const double pose_tolerance)
+        : txn_(txn), pose_tolerance_(pose_tolerance) {}
+
+    pg_map_sync(const pg_map_sync&) = delete;
+    pg_map_sync& operator=(const pg_map_sync&) = delete;
+
+    // Nodes must all be added before the first edge
+    bool add_node(const map_keyframe& keyfrm) {
+        if (!nodes_.emplace(keyfrm.id, node_state{keyfrm.timestamp, keyfrm.pose_cw, keyfrm.trans_wc}).second) {
+            spdlog::warn("Keyframe {} is in more than one map, keeping the first", keyfrm.id);
+            return false;
+        }
+        node_timestamps_.add(keyfrm.timestamp, keyfrm.id);
+        return true;
+    }
+
+    // Adds the edge in both directions, edges to unknown keyframes are dropped
+    void add_edge(const unsigned int keyfrm_id, const unsigned int other_id, const int type) {
+        if (nodes_.count(keyfrm_id) == 0 || nodes_.count(other_id) == 0) {
+            return;
+        }
+        edges_.emplace(edge_key(keyfrm_id, other_id), type);
+        edges_.emplace(edge_key(other_id, keyfrm_id), type);
+    }
+
+    std::vector<long> match_timestamps(const std::vector<double>& timestamps) {
+        return node_timestamps_.match(timestamps);
+    }
+
+    bool add_location(const unsigned int keyfrm_id, const std::string& location) {
+        if (nodes_.count(keyfrm_id) == 0) {
+            return false;
+        }
+        return locations_.emplace(keyfrm_id, location).second;
+    }
+
+    sync_stats apply() {
+        sync_stats stats;
+
+        // node_locations
+        std::vector<unsigned int> location_deletes;
+        std::vector<std::pair<unsigned int, std::string>> location_inserts, location_updates;
+        {
+            std::unordered_set<unsigned int> seen;
+            for (const auto& row : txn_.exec("SELECT keyframe_id, location FROM node_locations")) {
+                const auto id = row[0].as<unsigned int>();
+                const std::string location = row[1].is_null() ? "" : row[1].c_str();
+                seen.insert(id);
+                const auto it = locations_.find(id);
+                if (it == locations_.end()) {
+                    location_deletes.push_back(id);
+                }
+                else if (row[1].is_null() || it->second != location) {
+                    location_updates.emplace_back(id, it->second);
+                }
+            }
+            for (const auto& location : locations_) {
+                if (seen.count(location.first) == 0) {
+                    location_inserts.emplace_back(location.first, location.second);
+                }
+            }
+        }
+
+        // edges
+        std::vector<uint64_t> edge_deletes;
+        std::vector<std::pair<uint64_t, int>> edge_inserts, edge_updates;
+        {
+            std::unordered_set<uint64_t> seen;
+            for (const auto& row : txn_.exec("SELECT keyframe_id0, keyframe_id1, type FROM edges")) {
+                const auto key = edge_key(row[0].as<unsigned int>(), row[1].as<unsigned int>());
+                const int type = row[2].is_null() ? -1 : row[2].as<int>();
+                seen.insert(key);
+                const auto it = edges_.find(key);
+                if (it == edges_.end()) {
+                    edge_deletes.push_back(key);
+                }
+                else if (it->second != type) {
+                    edge_updates.emplace_back(key, it->second);
+                }
+            }
+            for (const auto& edge : edges_) {
+                if (seen.count(edge.first) == 0) {
+                    edge_inserts.push_back(edge);
+                }
+            }
+        }
+
+        // nodes
+        std::vector<unsigned int> node_deletes, node_inserts, node_updates;
+        {
+            std::unordered_set<unsigned int> seen;
+            for (const auto& row : txn_.exec("SELECT keyframe_id, ts::DOUBLE PRECISION, pose FROM nodes")) {
+                const auto id = row[0].as<unsigned int>();
+                seen.insert(id);
+                const auto it = nodes_.find(id);
+                if (it == nodes_.end()) {
+                    node_deletes.push_back(id);
+                }
+                else if (pose_tolerance_ < std::abs(it->second.timestamp - row[1].as<double>())
+                         || !pose_matches(row[2].c_str(), it->second.pose_cw)) {
+                    node_updates.push_back(id);
+                }
+            }
+            for (const auto& node : nodes_) {
+                if (seen.count(node.first) == 0) {
+                    node_inserts.push_back(node.first);
+                }
+            }
+        }
+
+        // everything referencing a node goes before the node itself, and comes back after it
+        if (!location_deletes.empty()) {
+            stats.locations_deleted = txn_.exec_params("DELETE FROM node_locations WHERE keyframe_id = ANY($1::INTEGER[])",
+                                                       pg_int_array(location_deletes))
+                                          .affected_rows();
+        }
+        if (!edge_deletes.empty()) {
+            std::vector<unsigned int> ids0, ids1;
+            split_edge_keys(edge_deletes, ids0, ids1);
+            stats.edges_deleted = txn_.exec_params("DELETE FROM edges e USING unnest($1::INTEGER[], $2::INTEGER[]) AS d(id0, id1) "
+                                                   "WHERE e.keyframe_id0 = d.id0 AND e.keyframe_id1 = d.id1",
+                                                   pg_int_array(ids0), pg_int_array(ids1))
+                                      .affected_rows();
+        }
+        if (!node_deletes.empty()) {
+            stats.nodes_deleted = txn_.exec_params("DELETE FROM nodes WHERE keyframe_id = ANY($1::INTEGER[])",
+                                                   pg_int_array(node_deletes))
+                                      .affected_rows();
+        }
+
+        if (!node_inserts.empty()) {
+            write_nodes("nodes", node_inserts);
+            stats.nodes_inserted = node_inserts.size();
+        }
+        if (!node_updates.empty()) {
+            txn_.exec("CREATE TEMP TABLE node_updates (keyframe_id INTEGER, ts NUMERIC, pose DOUBLE PRECISION[], "
+                      "x_trans DOUBLE PRECISION, y_trans DOUBLE PRECISION, z_trans DOUBLE PRECISION) ON COMMIT DROP");
+            write_nodes("node_updates", node_updates);
+            stats.nodes_updated = txn_.exec("UPDATE nodes n SET ts = u.ts, pose = u.pose, x_trans = u.x_trans, y_trans = u.y_trans, z_trans = u.z_trans "
+                                            "FROM node_updates u WHERE n.keyframe_id = u.keyframe_id")
+                                      .affected_rows();
+        }
+
+        if (!edge_inserts.empty()) {
+            auto stream = open_copy_stream(txn_, "edges", "keyframe_id0, keyframe_id1, type");
+            for (const auto& edge : edge_inserts) {
+                *stream << std::make_tuple(static_cast<unsigned int>(edge.first >> 32), static_cast<unsigned int>(edge.first), edge.second);
+            }
+            stream->complete();
+            stats.edges_inserted = edge_inserts.size();
+        }
+        if (!edge_updates.empty()) {
+            std::vector<uint64_t> keys;
+            std::vector<int> types;
+            for (const auto& edge : edge_updates) {
+                keys.push_back(edge.first);
+                types.push_back(edge.second);
+            }
+            std::vector<unsigned int> ids0, ids1;
+            split_edge_keys(keys, ids0, ids1);
+            stats.edges_updated = txn_.exec_params("UPDATE edges e SET type = u.type FROM unnest($1::INTEGER[], $2::INTEGER[], $3::INTEGER[]) AS u(id0, id1, type) "
+                                                   "WHERE e.keyframe_id0 = u.id0 AND e.keyframe_id1 = u.id1",
+                                                   pg_int_array(ids0), pg_int_array(ids1), pg_int_array(types))
+                                      .affected_rows();
+        }
+
+        if (!location_inserts.empty()) {
+            auto stream = open_copy_stream(txn_, "node_locations", "keyframe_id, location");
+            for (const auto& location : location_inserts) {
+                *stream << std::make_tuple(location.first, location.second);
+            }
+            stream->complete();
+            stats.locations_inserted = location_inserts.size();
+        }
+        for (const auto& location : location_updates) {
+            stats.locations_updated += txn_.exec_params("UPDATE node_locations SET location = $2 WHERE keyframe_id = $1",
+                                                        location.first, location.second)
+                                           .affected_rows();
+        }
+
+        return stats;
+    }
+
+private:
+    struct node_state {
+        double timestamp;
+        std::array<double, 16> pose_cw;
+        std::array<double, 3> trans_wc;
+    };
+
+    static uint64_t edge_key(const unsigned int id0, const unsigned int id1) {
+        return (static_cast<uint64_t>(id0) << 32) | id1;
+    }
+
+    static void split_edge_keys(const std::vector<uint64_t>& keys, std::vector<unsigned int>& ids0, std::vector<unsigned int>& ids1) {
+        for (const auto key : keys) {
+            ids0.push_back(static_cast<unsigned int>(key >> 32));
+            ids1.push_back(static_cast<unsigned int>(key));
+        }
+    }
+
+    // Compares a pose array as Postgres prints it, "{a,b,...}", element by element
+    bool pose_matches(const char* text, const std::array<double, 16>& pose_cw) const {
+        const char* p = text;
+        for (size_t i = 0; i < pose_cw.size(); ++i) {
+            while (*p == '{' || *p == ',' || *p == ' ') {
+                ++p;
+            }
+            char* end = nullptr;
+            const double value = std::strtod(p, &end);
+            if (end == p || pose_tolerance_ < std::abs(value - pose_cw[i])) {
+                return false;
+            }
+            p = end;
+        }
+        return true;
+    }
+
+    void write_nodes(const std::string& table, const std::vector<unsigned int>& ids) {
+        auto stream = open_copy_stream(txn_, table, "keyframe_id, ts, pose, x_trans, y_trans, z_trans");
+        for (const auto id : ids) {
+            const auto& node = nodes_.at(id);
+            *stream << std::make_tuple(id, node.timestamp, pose_formatter_.format(node.pose_cw),
+                                       node.trans_wc[0], node.trans_wc[1], node.trans_wc[2]);
+        }
+        stream->complete();
+    }
+
+    pqxx::work& txn_;
+    const double pose_tolerance_;
+    pg_double_array_formatter pose_formatter_;
+
+    std::map<unsigned int, node_state> nodes_;
+    std::unordered_map<uint64_t, int> edges_;
+    std::unordered_map<unsigned int, std::string> locations_;
+    keyframe_timestamp_index node_timestamps_;
+};
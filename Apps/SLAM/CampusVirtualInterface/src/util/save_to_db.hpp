@@ -5,8 +5,10 @@
 #include <fstream>
 #include <numeric>
 #include <string>
+#include <vector>
 
 #include <sqlite3.h>
+#include <spdlog/spdlog.h>
 
 #include <ghc/filesystem.hpp>
 namespace fs = ghc::filesystem;
@@ -76,174 +78,143 @@ std::vector<timestamp_group> load_timestamp_groups(sqlite3* db) {
 }
 
 
-int save_timestamp_groups_to_db(sqlite3 *db, std::string group, double timestamp, double ms){
-    
-    std::vector<std::pair<std::string, std::string>> columns{
-        {"name", "BLOB"},
-        {"timestamp", "REAL"},
-        {"ms", "NUMERIC"}
-        };
-
-    int ret = 0;
-    if (ret == SQLITE_OK) {
-        std::string stmt_str = "CREATE TABLE IF NOT EXISTS timestamp_groups(id INTEGER PRIMARY KEY AUTOINCREMENT";
-        for (const auto& column : columns) {
-            stmt_str += ", " + column.first + " " + column.second;
+// Writes the keyframe groups and video time ranges of a run into the map database.
+// The tables are created and the upserts prepared once, then each write() binds and steps every row inside
+// a single transaction, so persisting thousands of keyframes costs one commit.
+// A keyframe group is keyed by its timestamp and a video by (name, start_ts), so writing a row again updates
+// it in place and the tables do not grow when runs are chained on the same map database.
+class metadata_db_writer {
+public:
+    // With use_wal the database switches to WAL journaling and synchronous=NORMAL, which syncs the log
+    // at checkpoints instead of on every commit. The journal mode is stored in the database file.
+    explicit metadata_db_writer(sqlite3* db, const bool use_wal = false)
+        : db_(db) {
+        if (use_wal) {
+            exec("PRAGMA journal_mode=WAL;", "journal_mode");
+            exec("PRAGMA synchronous=NORMAL;", "synchronous");
         }
-        stmt_str += ");";
-        ret = sqlite3_exec(db, stmt_str.c_str(), nullptr, nullptr, nullptr);
+        ready_ = exec("CREATE TABLE IF NOT EXISTS timestamp_groups(id INTEGER PRIMARY KEY AUTOINCREMENT, name BLOB, timestamp REAL, ms NUMERIC);", "create_table")
+                 && exec("CREATE TABLE IF NOT EXISTS video_timestamps(id INTEGER PRIMARY KEY AUTOINCREMENT, name BLOB, start_ts REAL, end_ts REAL);", "create_table")
+                 && create_unique_index("timestamp_groups_timestamp", "timestamp_groups", "timestamp")
+                 && create_unique_index("video_timestamps_name_start_ts", "video_timestamps", "name, start_ts")
+                 && prepare("INSERT INTO timestamp_groups(name, timestamp, ms) VALUES(?, ?, ?) "
+                            "ON CONFLICT(timestamp) DO UPDATE SET name = excluded.name, ms = excluded.ms "
+                            "WHERE name IS NOT excluded.name OR ms IS NOT excluded.ms",
+                            &insert_group_)
+                 && prepare("INSERT INTO video_timestamps(name, start_ts, end_ts) VALUES(?, ?, ?) "
+                            "ON CONFLICT(name, start_ts) DO UPDATE SET end_ts = excluded.end_ts "
+                            "WHERE end_ts IS NOT excluded.end_ts",
+                            &insert_video_);
     }
 
-    if (ret != SQLITE_OK) {
-        spdlog::error("SQLite error (create_table): {}", sqlite3_errmsg(db));
-        return false;
+    ~metadata_db_writer() {
+        sqlite3_finalize(insert_group_);
+        sqlite3_finalize(insert_video_);
     }
 
-    if (ret == SQLITE_OK) {
-        ret = sqlite3_exec(db, "BEGIN;", nullptr, nullptr, nullptr);
+    metadata_db_writer(const metadata_db_writer&) = delete;
+    metadata_db_writer& operator=(const metadata_db_writer&) = delete;
+
+    bool is_ready() const {
+        return ready_;
     }
 
-    sqlite3_stmt* stmt = nullptr;
-    if (ret == SQLITE_OK) {
-        std::string stmt_str = "INSERT INTO timestamp_groups(";
-        bool first = true;
-        for (const auto& column : columns) {
-            if (first) {
-                stmt_str += column.first;
-                first = false;
-            } else {
-                stmt_str += ", " + column.first;
+    // Upsert the rows from groups_from and videos_from on in one transaction, nothing is written if any row fails
+    bool write(const std::vector<timestamp_group>& timestamp_groups, const std::vector<video_timestamp>& video_timestamps,
+               const size_t groups_from = 0, const size_t videos_from = 0) {
+        if (!ready_ || !exec("BEGIN;", "begin")) {
+            return false;
+        }
+        for (size_t i = groups_from; i < timestamp_groups.size(); ++i) {
+            const auto& timestamp_group = timestamp_groups.at(i);
+            if (!insert(insert_group_, timestamp_group.group, timestamp_group.timestamp, timestamp_group.ms)) {
+                exec("ROLLBACK;", "rollback");
+                return false;
             }
         }
-        stmt_str += ") VALUES(";
-        first = true;
-        for (size_t i = 0; i < columns.size(); ++i) {
-            if (first) {
-                stmt_str += "?";
-                first = false;
-            } else {
-                stmt_str += ", ?";
+        for (size_t i = videos_from; i < video_timestamps.size(); ++i) {
+            const auto& video_timestamp = video_timestamps.at(i);
+            if (!insert(insert_video_, video_timestamp.name, video_timestamp.start_timestamp, video_timestamp.stop_timestamp)) {
+                exec("ROLLBACK;", "rollback");
+                return false;
             }
         }
-        stmt_str += ")";
-        ret = sqlite3_prepare_v2(db, stmt_str.c_str(), -1, &stmt, nullptr);
-    }
-    if (ret != SQLITE_OK) {
-        spdlog::error("SQLite error (prepare): {}", sqlite3_errmsg(db));
-        return false;
+        return exec("COMMIT;", "commit");
     }
 
-    if (ret == SQLITE_OK) {
-        ret = sqlite3_bind_blob(stmt, 1, group.c_str(), group.size(), SQLITE_TRANSIENT);
-    }
-    if (ret == SQLITE_OK) {
-        ret = sqlite3_bind_double(stmt, 2, timestamp);
-    }
-    if (ret == SQLITE_OK) {
-        ret = sqlite3_bind_double(stmt, 3, ms);
-    }
-    
-    
-
-    if (ret == SQLITE_OK) {
-            ret = sqlite3_step(stmt);
-    }
-    if (ret != SQLITE_DONE) {
-        spdlog::error("SQLite step failed: {}", sqlite3_errmsg(db));
-        return false;
-    }
-    sqlite3_finalize(stmt);
-    ret = sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr);
-    if (ret != SQLITE_OK) {
-        spdlog::error("SQLite error (commit): {}", sqlite3_errmsg(db));
-        return false;
-    }
-
-    return 0;
-}
-
-
-
-int save_video_to_db(sqlite3 *db, std::string video_name, double start_timestamp, double end_timestamp){
-    
-    std::vector<std::pair<std::string, std::string>> columns{
-        {"name", "BLOB"},
-        {"start_ts", "REAL"},
-        {"end_ts", "REAL"}};
-
-    int ret = 0;
-    if (ret == SQLITE_OK) {
-        std::string stmt_str = "CREATE TABLE IF NOT EXISTS video_timestamps(id INTEGER PRIMARY KEY AUTOINCREMENT";
-        for (const auto& column : columns) {
-            stmt_str += ", " + column.first + " " + column.second;
+private:
+    bool exec(const char* sql, const char* what) {
+        if (sqlite3_exec(db_, sql, nullptr, nullptr, nullptr) != SQLITE_OK) {
+            spdlog::error("SQLite error ({}): {}", what, sqlite3_errmsg(db_));
+            return false;
         }
-        stmt_str += ");";
-        ret = sqlite3_exec(db, stmt_str.c_str(), nullptr, nullptr, nullptr);
-    }
-
-    if (ret != SQLITE_OK) {
-        spdlog::error("SQLite error (create_table): {}", sqlite3_errmsg(db));
-        return false;
+        return true;
     }
 
-    if (ret == SQLITE_OK) {
-        ret = sqlite3_exec(db, "BEGIN;", nullptr, nullptr, nullptr);
-    }
+    // Databases written before the keys existed hold a copy of the whole history for every chained run,
+    // those duplicates are dropped (keeping the first row) before the index is created
+    bool create_unique_index(const std::string& index, const std::string& table, const std::string& columns) {
+        sqlite3_stmt* stmt = nullptr;
+        if (!prepare("SELECT 1 FROM sqlite_master WHERE type = 'index' AND name = ?", &stmt)) {
+            return false;
+        }
+        sqlite3_bind_text(stmt, 1, index.c_str(), -1, SQLITE_TRANSIENT);
+        const bool exists = sqlite3_step(stmt) == SQLITE_ROW;
+        sqlite3_finalize(stmt);
+        if (exists) {
+            return true;
+        }
 
-    sqlite3_stmt* stmt = nullptr;
-    if (ret == SQLITE_OK) {
-        std::string stmt_str = "INSERT INTO video_timestamps(";
-        bool first = true;
-        for (const auto& column : columns) {
-            if (first) {
-                stmt_str += column.first;
-                first = false;
-            } else {
-                stmt_str += ", " + column.first;
-            }
+        const std::string dedup = "DELETE FROM " + table + " WHERE id NOT IN (SELECT MIN(id) FROM " + table + " GROUP BY " + columns + ");";
+        const std::string create = "CREATE UNIQUE INDEX " + index + " ON " + table + "(" + columns + ");";
+        if (!exec("BEGIN;", "begin")) {
+            return false;
         }
-        stmt_str += ") VALUES(";
-        first = true;
-        for (size_t i = 0; i < columns.size(); ++i) {
-            if (first) {
-                stmt_str += "?";
-                first = false;
-            } else {
-                stmt_str += ", ?";
-            }
+        if (!exec(dedup.c_str(), "dedup")) {
+            exec("ROLLBACK;", "rollback");
+            return false;
         }
-        stmt_str += ")";
-        ret = sqlite3_prepare_v2(db, stmt_str.c_str(), -1, &stmt, nullptr);
-    }
-    if (ret != SQLITE_OK) {
-        spdlog::error("SQLite error (prepare): {}", sqlite3_errmsg(db));
-        return false;
+        const int num_removed = sqlite3_changes(db_);
+        if (!exec(create.c_str(), "create_index")) {
+            exec("ROLLBACK;", "rollback");
+            return false;
+        }
+        if (num_removed != 0) {
+            spdlog::info("Removed {} duplicate rows from {}", num_removed, table);
+        }
+        return exec("COMMIT;", "commit");
     }
 
-    
-    if (ret == SQLITE_OK) {
-        ret = sqlite3_bind_blob(stmt, 1, video_name.c_str(), video_name.size(), SQLITE_TRANSIENT);
-    }
-    if (ret == SQLITE_OK) {
-        ret = sqlite3_bind_double(stmt, 2, start_timestamp);
-    }
-    if (ret == SQLITE_OK) {
-        ret = sqlite3_bind_double(stmt, 3, end_timestamp);
+    bool prepare(const char* sql, sqlite3_stmt** stmt) {
+        if (sqlite3_prepare_v2(db_, sql, -1, stmt, nullptr) != SQLITE_OK) {
+            spdlog::error("SQLite error (prepare): {}", sqlite3_errmsg(db_));
+            return false;
+        }
+        return true;
     }
 
-    if (ret == SQLITE_OK) {
+    bool insert(sqlite3_stmt* stmt, const std::string& name, const double value0, const double value1) {
+        int ret = sqlite3_bind_blob(stmt, 1, name.c_str(), name.size(), SQLITE_STATIC);
+        if (ret == SQLITE_OK) {
+            ret = sqlite3_bind_double(stmt, 2, value0);
+        }
+        if (ret == SQLITE_OK) {
+            ret = sqlite3_bind_double(stmt, 3, value1);
+        }
+        if (ret == SQLITE_OK) {
             ret = sqlite3_step(stmt);
-    }
-    if (ret != SQLITE_DONE) {
-        spdlog::error("SQLite step failed: {}", sqlite3_errmsg(db));
-        return false;
-    }
-    sqlite3_finalize(stmt);
-    ret = sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr);
-    if (ret != SQLITE_OK) {
-        spdlog::error("SQLite error (commit): {}", sqlite3_errmsg(db));
-        return false;
+        }
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+        if (ret != SQLITE_DONE) {
+            spdlog::error("SQLite step failed: {}", sqlite3_errmsg(db_));
+            return false;
+        }
+        return true;
     }
 
-    return 0;
-}
+    sqlite3* db_;
+    sqlite3_stmt* insert_group_ = nullptr;
+    sqlite3_stmt* insert_video_ = nullptr;
+    bool ready_ = false;
+};
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+// Uniform grid over the XZ plane of keyframe positions, for "which keyframes are within radius on the floor and
+// y_dist vertically of this point" without looking at every keyframe. Each cell lists its nodes sorted by Y,
+// so the vertical band is a binary search inside the cell. Distances are in world units, like the positions.
+//
+// The grid only references the position arrays it was built from, they must outlive it.
+class spatial_grid {
+public:
+    // cell_size is the side of a cell in world units, about the usual query radius works best
+    spatial_grid(const double* x, const double* y, const double* z, const uint32_t num_nodes, double cell_size)
+        : x_(x), z_(z) {
+        if (num_nodes == 0) {
+            return;
+        }
+        if (!(0.0 < cell_size)) {
+            cell_size = 1.0;
+        }
+        const auto x_range = std::minmax_element(x, x + num_nodes);
+        const auto z_range = std::minmax_element(z, z + num_nodes);
+        min_x_ = *x_range.first;
+        min_z_ = *z_range.first;
+        // keep the number of cells in proportion to the number of nodes, however spread out the map is
+        const double max_cells = 4.0 * num_nodes + 16.0;
+        while (true) {
+            num_cols_ = static_cast<uint32_t>((*x_range.second - min_x_) / cell_size) + 1;
+            num_rows_ = static_cast<uint32_t>((*z_range.second - min_z_) / cell_size) + 1;
+            if (static_cast<double>(num_cols_) * num_rows_ <= max_cells) {
+                break;
+            }
+            cell_size *= 2.0;
+        }
+        cell_size_ = cell_size;
+
+        // counting sort of the nodes by cell, then by Y inside each cell
+        std::vector<uint32_t> cells(num_nodes);
+        cell_offsets_.assign(static_cast<size_t>(num_cols_) * num_rows_ + 1, 0);
+        for (uint32_t node = 0; node < num_nodes; ++node) {
+            cells[node] = cell(col(x[node]), row(z[node]));
+            ++cell_offsets_[cells[node] + 1];
+        }
+        std::partial_sum(cell_offsets_.begin(), cell_offsets_.end(), cell_offsets_.begin());
+        nodes_.resize(num_nodes);
+        std::vector<uint32_t> next(cell_offsets_.begin(), cell_offsets_.end() - 1);
+        for (uint32_t node = 0; node < num_nodes; ++node) {
+            nodes_[next[cells[node]]++] = node;
+        }
+        node_y_.resize(num_nodes);
+        for (size_t c = 0; c + 1 < cell_offsets_.size(); ++c) {
+            const auto begin = nodes_.begin() + cell_offsets_[c];
+            const auto end = nodes_.begin() + cell_offsets_[c + 1];
+            std::sort(begin, end, [y](const uint32_t a, const uint32_t b) {
+                return y[a] < y[b];
+            });
+            for (auto i = cell_offsets_[c]; i < cell_offsets_[c + 1]; ++i) {
+                node_y_[i] = y[nodes_[i]];
+            }
+        }
+    }
+
+    double cell_size() const {
+        return cell_size_;
+    }
+
+    // Calls visit(node, squared XZ distance) for every node with an XZ distance to the point of at most radius
+    // and a Y distance of at most y_dist, in no particular order
+    template <typename Visitor>
+    void visit_within(const double x, const double y, const double z, const double radius, const double y_dist,
+                      Visitor&& visit) const {
+        if (nodes_.empty() || radius < 0.0 || y_dist < 0.0) {
+            return;
+        }
+        const double radius_sq = radius * radius;
+        const auto col_begin = col(x - radius);
+        const auto col_end = col(x + radius);
+        const auto row_begin = row(z - radius);
+        const auto row_end = row(z + radius);
+        for (auto r = row_begin; r <= row_end; ++r) {
+            for (auto c = col_begin; c <= col_end; ++c) {
+                const auto index = cell(c, r);
+                const auto band_begin = std::lower_bound(node_y_.begin() + cell_offsets_[index],
+                                                         node_y_.begin() + cell_offsets_[index + 1], y - y_dist);
+                for (auto it = band_begin; it != node_y_.begin() + cell_offsets_[index + 1] && *it <= y + y_dist; ++it) {
+                    const auto node = nodes_[it - node_y_.begin()];
+                    const double dx = x_[node] - x;
+                    const double dz = z_[node] - z;
+                    const double dist_sq = dx * dx + dz * dz;
+                    if (dist_sq <= radius_sq) {
+                        visit(node, dist_sq);
+                    }
+                }
+            }
+        }
+    }
+
+    // Nodes within radius and y_dist of the point, in no particular order
+    void within(const double x, const double y, const double z, const double radius, const double y_dist,
+                std::vector<uint32_t>& nodes) const {
+        nodes.clear();
+        visit_within(x, y, z, radius, y_dist, [&nodes](const uint32_t node, double) {
+            nodes.push_back(node);
+        });
+    }
+
+private:
+    // Column and row of a coordinate, clamped to the grid so queries reaching past the map stay inside it
+    uint32_t col(const double x) const {
+        return clamp_index((x - min_x_) / cell_size_, num_cols_);
+    }
+
+    uint32_t row(const double z) const {
+        return clamp_index((z - min_z_) / cell_size_, num_rows_);
+    }
+
+    static uint32_t clamp_index(const double index, const uint32_t count) {
+        if (!(0.0 < index)) {
+            return 0;
+        }
+        return index < count ? static_cast<uint32_t>(index) : count - 1;
+    }
+
+    uint32_t cell(const uint32_t col, const uint32_t row) const {
+        return row * num_cols_ + col;
+    }
+
+    const double* x_;
+    const double* z_;
+
+    double min_x_ = 0.0;
+    double min_z_ = 0.0;
+    double cell_size_ = 1.0;
+    uint32_t num_cols_ = 0;
+    uint32_t num_rows_ = 0;
+
+    std::vector<uint32_t> cell_offsets_; // nodes of cell c are [cell_offsets_[c], cell_offsets_[c + 1])
+    std::vector<uint32_t> nodes_;
+    std::vector<double> node_y_; // Y of nodes_, what the vertical band is searched in
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <opencv2/videoio.hpp>
+#include <spdlog/spdlog.h>
+#include <yaml-cpp/yaml.h>
+
+// FFmpeg decoder settings, read from the "Decoder" section of the config file, e.g.
+//
+// Decoder:
+//   num_threads: 0          # 0 = let FFmpeg use every core
+//   grayscale: false        # track on grayscale frames, colour is only kept for keyframe snapshots
+//
+// FFmpeg's thread type is left at its frame+slice default: OpenCV only hands OPENCV_FFMPEG_CAPTURE_OPTIONS to the
+// demuxer, so codec options set there never reach the decoder.
+struct decoder_config {
+    unsigned int num_threads = 0;
+    bool grayscale = false;
+};
+
+inline decoder_config load_decoder_config(const YAML::Node& yaml_node) {
+    decoder_config cfg;
+    cfg.num_threads = yaml_node["num_threads"].as<unsigned int>(cfg.num_threads);
+    cfg.grayscale = yaml_node["grayscale"].as<bool>(cfg.grayscale);
+    return cfg;
+}
+
+// Open a video for CPU-only FFmpeg decoding with the configured number of threads
+inline cv::VideoCapture open_video(const std::string& video_file_path, const decoder_config& cfg) {
+    std::vector<int> params;
+    params.push_back(cv::CAP_PROP_HW_ACCELERATION);
+    params.push_back(cv::VIDEO_ACCELERATION_NONE);
+    if (0 < cfg.num_threads) {
+        params.push_back(cv::CAP_PROP_N_THREADS);
+        params.push_back(static_cast<int>(cfg.num_threads));
+    }
+
+    spdlog::info("Opening {} with {} decoder threads", video_file_path, 0 < cfg.num_threads ? std::to_string(cfg.num_threads) : "auto");
+    return cv::VideoCapture(video_file_path, cv::CAP_FFMPEG, params);
+}
+
+// Counts decoded frames (including grabbed-only ones) to report the achieved decode rate
+class decode_rate_meter {
+public:
+    void start() {
+        start_ = std::chrono::steady_clock::now();
+    }
+
+    void add_decode_time(const std::chrono::steady_clock::duration& duration, const unsigned int num_frames = 1) {
+        decode_time_ += duration;
+        num_frames_ += num_frames;
+    }
+
+    void log() const {
+        const auto elapsed = std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - start_).count();
+        const auto decode_time = std::chrono::duration_cast<std::chrono::duration<double>>(decode_time_).count();
+        spdlog::info("Decoder: {} frames in {:.2f}[s] - {:.1f} fps overall, {:.1f} fps while decoding",
+                     num_frames_, elapsed,
+                     0.0 < elapsed ? num_frames_ / elapsed : 0.0,
+                     0.0 < decode_time ? num_frames_ / decode_time : 0.0);
+    }
+
+private:
+    std::chrono::steady_clock::time_point start_;
+    std::chrono::steady_clock::duration decode_time_{0};
+    unsigned long num_frames_ = 0;
+};
@@ -3,14 +3,51 @@
 #include <pqxx/pqxx>
 #include <boost/program_options.hpp>
 #include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 #include "include/json.hpp"  // nlodmann/json library
 
 namespace po = boost::program_options;
 
+// stream_to::raw_table() replaced the table name constructor in libpqxx 7.7
+#if PQXX_VERSION_MAJOR > 7 || (PQXX_VERSION_MAJOR == 7 && PQXX_VERSION_MINOR >= 7)
+#define PAIR_JSON_HAS_STREAM_TO_TABLE
+#endif
 
-void create_tables_if_not_exist(pqxx::connection &conn) {
-    pqxx::work txn(conn);
+struct video_range {
+    std::string name;
+    double start_ts;
+    double end_ts;
+};
 
+struct keyframe_ts {
+    double ts;
+    int keyframe_id;
+};
+
+struct node_location_row {
+    double ts;
+    int keyframe_id;
+    std::string group_id;
+};
+
+// Group timeline of one video, {"<seconds into the video>": "<group>", ...} sorted by time
+using group_timeline = std::vector<std::pair<double, std::string>>;
+
+double seconds_since(const std::chrono::steady_clock::time_point &tp) {
+    return std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - tp).count();
+}
+
+void create_tables_if_not_exist(pqxx::work &txn) {
     txn.exec(R"(
         CREATE TABLE IF NOT EXISTS node_location (
             id SERIAL PRIMARY KEY,
@@ -20,9 +57,58 @@ void create_tables_if_not_exist(pqxx::connection &conn) {
         );
     )");
     txn.exec("TRUNCATE TABLE node_location RESTART IDENTITY;");
+}
+
+// Parse a video's JSON file once into a timeline ordered by time. Object keys come out of nlohmann::json in
+// string order ("10" before "2"), so the entries are sorted numerically here.
+bool load_group_timeline(const std::string &json_filename, group_timeline &timeline) {
+    std::ifstream json_file(json_filename);
+    if (!json_file.is_open()) {
+        std::cerr << "Failed to open JSON file: " << json_filename << std::endl;
+        return false;
+    }
 
-    // Commit the transaction
-    txn.commit();
+    try {
+        nlohmann::json json_data;
+        json_file >> json_data;
+        timeline.reserve(json_data.size());
+        for (auto it = json_data.begin(); it != json_data.end(); ++it) {
+            timeline.emplace_back(std::stod(it.key()), it.value().is_string() ? it.value().get<std::string>() : it.value().dump());
+        }
+    } catch (const std::exception &e) {
+        std::cerr << "Failed to parse JSON file " << json_filename << ": " << e.what() << std::endl;
+        return false;
+    }
+
+    std::stable_sort(timeline.begin(), timeline.end(), [](const std::pair<double, std::string> &a, const std::pair<double, std::string> &b) {
+        return a.first < b.first;
+    });
+    return true;
+}
+
+// Pair every keyframe of a video with the group of the last timeline entry at or before its offset into the video.
+// keyframes is sorted by ts, so the keyframes of a range are a contiguous run and the timeline is walked once.
+void pair_video(const std::vector<video_range> &ranges,
+                const std::vector<keyframe_ts> &keyframes,
+                const group_timeline &timeline,
+                std::vector<node_location_row> &rows) {
+    for (const auto &range : ranges) {
+        auto it = std::lower_bound(keyframes.begin(), keyframes.end(), range.start_ts, [](const keyframe_ts &keyframe, const double ts) {
+            return keyframe.ts < ts;
+        });
+        size_t entry = 0;
+        const std::string no_group;
+        const std::string *group_name = &no_group;
+        for (; it != keyframes.end() && it->ts <= range.end_ts; ++it) {
+            // Calculate how far through the video file the keyframe timestamp is
+            const double offset = it->ts - range.start_ts;
+            while (entry < timeline.size() && timeline[entry].first <= offset) {
+                group_name = &timeline[entry].second;
+                ++entry;
+            }
+            rows.push_back({it->ts, it->keyframe_id, *group_name});
+        }
+    }
 }
 
 int main(int argc, char *argv[]) {
@@ -32,7 +118,9 @@ int main(int argc, char *argv[]) {
         ("help,h", "produce help message")
         ("map-db-in,i", po::value<std::string>()->required(), "load a map from this path")
         ("json_dir,j", po::value<std::string>()->required(), "json_dir")
-        ("db,d", po::value<std::string>()->required(), "postgres connection string");
+        ("db,d", po::value<std::string>()->required(), "postgres connection string")
+        ("threads,t", po::value<unsigned int>()->default_value(std::max(1u, std::thread::hardware_concurrency())), "videos paired in parallel")
+        ("dry-run", "pair keyframes and report throughput without writing to postgres");
 
     po::variables_map vm;
 
@@ -53,29 +141,28 @@ int main(int argc, char *argv[]) {
     std::string map_db_path_in = vm["map-db-in"].as<std::string>();
     std::string json_dir = vm["json_dir"].as<std::string>();
     std::string postgres_connection = vm["db"].as<std::string>();
+    const unsigned int num_threads = std::max(1u, vm["threads"].as<unsigned int>());
+    const bool dry_run = vm.count("dry-run") != 0;
+
+    const auto tp_start = std::chrono::steady_clock::now();
 
     sqlite3 *db;
     int rc;
 
-    rc = sqlite3_open(map_db_path_in.c_str(), &db);
+    rc = sqlite3_open_v2(map_db_path_in.c_str(), &db, SQLITE_OPEN_READONLY, nullptr);
 
     if (rc) {
         std::fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
+        sqlite3_close(db);
         return EXIT_FAILURE;
     } else {
         std::fprintf(stderr, "Opened sqlite3 database successfully\n");
     }
 
-    pqxx::connection conn(postgres_connection);
-
-    if (conn.is_open()) {
-        std::cout << "Connected to postgres" << std::endl;
-    } else {
-        std::cout << "Couldn't connect to postgres" << std::endl;
-        return EXIT_FAILURE;
-    }
-
-    // Look for all distinct video_timestamp names
+    // Look for all distinct video_timestamp names, grouped by video so each JSON file is parsed once
+    std::map<std::string, std::vector<video_range>> videos;
+    double min_ts = 0.0, max_ts = 0.0;
+    unsigned int num_ranges = 0;
     sqlite3_stmt *stmt;
     std::string sql = "SELECT DISTINCT name, start_ts, end_ts FROM video_timestamps;";
     rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
@@ -84,57 +171,127 @@ int main(int argc, char *argv[]) {
         sqlite3_close(db);
         return EXIT_FAILURE;
     }
-
-    // Execute SQLite query
     while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
-        const char *video_name = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0));
-        double start_ts = sqlite3_column_double(stmt, 1);
-        double end_ts = sqlite3_column_double(stmt, 2);
+        video_range range{reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0)), sqlite3_column_double(stmt, 1), sqlite3_column_double(stmt, 2)};
+        if (num_ranges == 0 || range.start_ts < min_ts) {
+            min_ts = range.start_ts;
+        }
+        if (num_ranges == 0 || max_ts < range.end_ts) {
+            max_ts = range.end_ts;
+        }
+        ++num_ranges;
+        videos[range.name].push_back(range);
+    }
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+
+    if (num_ranges == 0) {
+        std::cout << "No videos in " << map_db_path_in << std::endl;
+        return 0;
+    }
 
-        // Query keyframes from PostgreSQL within the start-end range
-        pqxx::nontransaction ntxn(conn);
-        pqxx::result keyframes =
-            ntxn.exec("SELECT keyframe_id, ts FROM nodes WHERE ts >= " + std::to_string(start_ts) + " AND ts <= " + std::to_string(end_ts));
+    try {
+        pqxx::connection conn(postgres_connection);
 
-        // Process each keyframe
-        for (const auto &keyframe : keyframes) {
-            double keyframe_ts = keyframe["ts"].as<double>();
+        if (conn.is_open()) {
+            std::cout << "Connected to postgres" << std::endl;
+        } else {
+            std::cout << "Couldn't connect to postgres" << std::endl;
+            return EXIT_FAILURE;
+        }
 
-            // Calculate how far through the video file the keyframe timestamp is
-            double offset = keyframe_ts - start_ts;
-
-            // Open JSON file based on video name
-            std::string json_filename = json_dir + "/" + std::string(video_name) + ".json";
-            std::ifstream json_file(json_filename);
-            if (!json_file.is_open()) {
-                std::cerr << "Failed to open JSON file: " << json_filename << std::endl;
-                continue;
+        // Query the keyframes of every video at once, sorted so each range is a contiguous run
+        auto tp = std::chrono::steady_clock::now();
+        std::vector<keyframe_ts> keyframes;
+        {
+            pqxx::nontransaction ntxn(conn);
+            const pqxx::result result = ntxn.exec_params("SELECT keyframe_id, ts::DOUBLE PRECISION FROM nodes WHERE ts >= $1 AND ts <= $2 ORDER BY ts", min_ts, max_ts);
+            keyframes.reserve(result.size());
+            for (const auto &row : result) {
+                keyframes.push_back({row[1].as<double>(), row[0].as<int>()});
             }
+        }
+        const double query_time = seconds_since(tp);
 
-            // Parse JSON
-            nlohmann::json json_data;
-            json_file >> json_data;
+        // Parse and pair the videos in parallel, each into its own rows
+        tp = std::chrono::steady_clock::now();
+        std::vector<const std::vector<video_range> *> video_list;
+        for (const auto &video : videos) {
+            video_list.push_back(&video.second);
+        }
+        std::vector<std::vector<node_location_row>> video_rows(video_list.size());
+        std::atomic<size_t> next_video{0};
+        std::atomic<size_t> num_timeline_entries{0};
+        std::vector<std::thread> workers;
+        for (unsigned int i = 0; i < std::min<size_t>(num_threads, video_list.size()); ++i) {
+            workers.emplace_back([&]() {
+                for (size_t idx = next_video++; idx < video_list.size(); idx = next_video++) {
+                    const auto &ranges = *video_list.at(idx);
+                    group_timeline timeline;
+                    if (!load_group_timeline(json_dir + "/" + ranges.front().name + ".json", timeline)) {
+                        continue;
+                    }
+                    num_timeline_entries += timeline.size();
+                    pair_video(ranges, keyframes, timeline, video_rows.at(idx));
+                }
+            });
+        }
+        for (auto &worker : workers) {
+            worker.join();
+        }
 
-            // Find the entry in JSON where ts is within
-            std::string group_name;
-            for (auto it = json_data.begin(); it != json_data.end(); ++it) {
-                double ts = std::stod(it.key());
-                if (keyframe_ts >= ts) {
-                    group_name = it.value();
+        // keyframe_id is unique in node_location, a keyframe in overlapping ranges keeps its first pairing
+        std::vector<node_location_row> rows;
+        std::unordered_set<int> paired_ids;
+        unsigned int num_duplicates = 0;
+        for (auto &video : video_rows) {
+            for (auto &row : video) {
+                if (paired_ids.insert(row.keyframe_id).second) {
+                    rows.push_back(std::move(row));
                 } else {
-                    break;
+                    ++num_duplicates;
                 }
             }
+        }
+        const double pair_time = seconds_since(tp);
+
+        std::cout << "Paired " << rows.size() << " keyframes of " << videos.size() << " videos (" << num_ranges << " ranges, "
+                  << num_timeline_entries << " timeline entries) in " << pair_time << "[s] - "
+                  << rows.size() / std::max(pair_time, 1e-9) << " keyframes/s" << std::endl;
+        if (num_duplicates != 0) {
+            std::cout << "Skipped " << num_duplicates << " keyframes already paired with an earlier video" << std::endl;
+        }
+        std::cout << "Keyframe query: " << keyframes.size() << " keyframes in " << query_time << "[s]" << std::endl;
 
-            // INSERT into node_location table
-            pqxx::work txn(conn);
-            txn.exec_params("INSERT INTO node_location (ts, keyframe_id, group_id) VALUES ($1, $2, $3)", keyframe_ts, keyframe["keyframe_id"].as<int>(),
-                            group_name);
-            txn.commit();
+        if (dry_run) {
+            std::cout << "Dry run - nothing written, total " << seconds_since(tp_start) << "[s]" << std::endl;
+            return 0;
+        }
+
+        // Replace node_location with one COPY in a single transaction
+        tp = std::chrono::steady_clock::now();
+        pqxx::work txn(conn);
+        create_tables_if_not_exist(txn);
+        {
+#ifdef PAIR_JSON_HAS_STREAM_TO_TABLE
+            auto stream = pqxx::stream_to::raw_table(txn, "node_location", "ts, keyframe_id, group_id");
+#else
+            pqxx::stream_to stream(txn, "node_location", std::vector<std::string>{"ts", "keyframe_id", "group_id"});
+#endif
+            for (const auto &row : rows) {
+                stream << std::make_tuple(row.ts, row.keyframe_id, row.group_id);
+            }
+            stream.complete();
         }
+        txn.commit();
+        const double write_time = seconds_since(tp);
+
+        std::cout << "Wrote " << rows.size() << " rows to node_location in " << write_time << "[s] - "
+                  << rows.size() / std::max(write_time, 1e-9) << " rows/s, total " << seconds_since(tp_start) << "[s]" << std::endl;
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
     }
 
-    sqlite3_finalize(stmt);
-    sqlite3_close(db);
     return 0;
 }